@@ -0,0 +1,468 @@
+/**
+ * @file benchmark.c
+ * @author Tobias Scharsching (12123692)
+ * @brief A program which measures the throughput of the myexpand engines on a corpus
+ * @date 2022-11-02
+ *
+ * For every input of the corpus (see corpus.c) and every engine, myexpand is
+ * run in a child process and the best wall time, the peak RSS, the count of
+ * syscalls (in an extra run under ptrace) and whether the output matches
+ * GNU expand or unexpand in the same mode are reported.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+/**
+ * @brief The maximal count of files of one input
+ */
+#define MAX_FILES 4096
+
+/**
+ * @brief The maximal count of arguments of a measured command
+ */
+#define MAX_ARGUMENTS (MAX_FILES + 8)
+
+/**
+ * @brief Size of the buffers used to feed pipes and compare outputs, in bytes
+ */
+#define COPY_SIZE (1 << 16)
+
+/**
+ * @brief An engine or mode of myexpand, or GNU expand
+ */
+typedef struct engine {
+    const char *name; /** name in the report */
+    const char *option; /** option passed to the command, or NULL */
+    bool piped; /** input is fed through a pipe on stdin instead of file arguments */
+    bool threaded; /** the thread count is passed with -j */
+    const char *gnu; /** GNU command run instead of myexpand, or NULL */
+    bool mode; /** starts a mode, the engines up to the next mode produce the same output */
+} engine_t;
+
+/**
+ * @brief The measured engines, grouped by mode; the GNU command comes first in its mode, its output is the expected one
+ */
+static const engine_t ENGINES[] = {
+    { "gnu-expand", NULL, false, false, "expand", true },
+    { "reference", "-r", false, false, NULL, false },
+    { "mapped", NULL, false, false, NULL, false },
+    { "pipeline", NULL, true, false, NULL, false },
+    { "parallel", NULL, false, true, NULL, false },
+    { "gnu-tablist", "-t4,12,20", false, false, "expand", true },
+    { "tablist", "-t4,12,20", false, false, NULL, false },
+    { "tablist-par", "-t4,12,20", false, true, NULL, false },
+    { "gnu-unexp", "-a", false, false, "unexpand", true },
+    { "unexpand", "-U", false, false, NULL, false },
+    { "unexp-pipe", "-U", true, false, NULL, false },
+    /* GNU expand counts bytes, not display columns, so the first UTF-8 engine defines the output */
+    { "utf8", "-u", false, false, NULL, true },
+    { "utf8-pipe", "-u", true, false, NULL, false },
+    { "utf8-par", "-u", false, true, NULL, false },
+};
+
+/**
+ * @brief The inputs of the corpus, a trailing slash marks a directory of files
+ */
+static const char *const INPUTS[] = { "sparse.txt", "dense.txt", "mixed.txt", "giant.txt", "utf8.txt", "tiny/" };
+
+/**
+ * @brief Result of one run of a command
+ */
+typedef struct measurement {
+    double seconds; /** wall time */
+    long maxRss; /** peak resident set size, in kilobytes */
+    long syscalls; /** count of syscalls, -1 if not counted */
+    bool succeeded; /** the command exited with success */
+} measurement_t;
+
+/**
+ * @brief Seconds of a monotonic clock
+ *
+ * @return the current time in seconds
+ */
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Compares two strings for qsort
+ *
+ * @param left pointer to the first string
+ * @param right pointer to the second string
+ * @return order of the strings as by strcmp
+ */
+static int compareNames(const void *left, const void *right)
+{
+    return strcmp(*(char *const *)left, *(char *const *)right);
+}
+
+/**
+ * @brief Collects the files of an input
+ *
+ * @param directory the corpus directory
+ * @param input the input name, a directory if it ends with a slash
+ * @param files array that receives allocated paths
+ * @return count of files, -1 on error
+ */
+static int collectFiles(const char *directory, const char *input, char **files)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", directory, input);
+    if (input[strlen(input) - 1] != '/')
+    {
+        files[0] = strdup(path);
+        return files[0] == NULL ? -1 : 1;
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) return -1;
+
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && count < MAX_FILES)
+    {
+        if (entry->d_name[0] == '.') continue;
+        char file[sizeof(path) + sizeof(entry->d_name)];
+        snprintf(file, sizeof(file), "%s%s", path, entry->d_name);
+        files[count++] = strdup(file);
+    }
+    closedir(dir);
+
+    qsort(files, count, sizeof(char *), compareNames);
+    return count;
+}
+
+/**
+ * @brief Counts bytes and lines of the files of an input
+ *
+ * @param files the files
+ * @param count count of files
+ * @param bytes receives the count of bytes
+ * @param lines receives the count of newlines
+ */
+static void measureInput(char **files, int count, double *bytes, double *lines)
+{
+    char *buffer = malloc(COPY_SIZE);
+    *bytes = 0;
+    *lines = 0;
+
+    int i;
+    for (i = 0; buffer != NULL && i < count; i++)
+    {
+        FILE *stream = fopen(files[i], "r");
+        if (stream == NULL) continue;
+
+        size_t length;
+        while ((length = fread(buffer, 1, COPY_SIZE, stream)) > 0)
+        {
+            *bytes += length;
+            char *position = buffer;
+            while ((position = memchr(position, '\n', buffer + length - position)) != NULL)
+            {
+                (*lines)++;
+                position++;
+            }
+        }
+        fclose(stream);
+    }
+    free(buffer);
+}
+
+/**
+ * @brief Writes the concatenated files to a descriptor; runs in the feeder process
+ *
+ * @param files the files
+ * @param count count of files
+ * @param descriptor the write end of the pipe
+ */
+static void feed(char **files, int count, int descriptor)
+{
+    char *buffer = malloc(COPY_SIZE);
+    int i;
+    for (i = 0; buffer != NULL && i < count; i++)
+    {
+        int input = open(files[i], O_RDONLY);
+        if (input == -1) continue;
+
+        ssize_t length;
+        while ((length = read(input, buffer, COPY_SIZE)) > 0)
+        {
+            if (write(descriptor, buffer, length) != length) _exit(EXIT_FAILURE);
+        }
+        close(input);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief Follows a traced child and its threads and counts their syscalls
+ *
+ * @param child the traced child, stopped at its exec
+ * @param status receives the exit status of the child
+ * @return count of syscalls
+ */
+static long traceSyscalls(pid_t child, int *status)
+{
+    ptrace(PTRACE_SETOPTIONS, child, NULL, (void *)(long)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL));
+    ptrace(PTRACE_SYSCALL, child, NULL, NULL);
+
+    /* every syscall stops twice, on entry and on exit */
+    long stops = 0;
+    while (true)
+    {
+        int traceStatus;
+        pid_t stopped = waitpid(-1, &traceStatus, __WALL);
+        if (stopped == -1) break;
+
+        if (WIFEXITED(traceStatus) || WIFSIGNALED(traceStatus))
+        {
+            if (stopped != child) continue;
+            *status = traceStatus;
+            break;
+        }
+
+        int signal = 0;
+        if (WSTOPSIG(traceStatus) == (SIGTRAP | 0x80)) stops++;
+        else if (WSTOPSIG(traceStatus) != SIGTRAP && WSTOPSIG(traceStatus) != SIGSTOP) signal = WSTOPSIG(traceStatus);
+        ptrace(PTRACE_SYSCALL, stopped, NULL, (void *)(long)signal);
+    }
+    return stops / 2;
+}
+
+/**
+ * @brief Runs a command and measures it
+ *
+ * @param arguments the command, NULL terminated
+ * @param files the input files, fed through a pipe if piped is set
+ * @param count count of files
+ * @param piped feed the files through a pipe on stdin
+ * @param outputPath the file stdout of the command is written to, stderr is discarded
+ * @param countSyscalls run the command under ptrace and count its syscalls
+ * @param measurement receives the results
+ */
+static void run(char **arguments, char **files, int count, bool piped, const char *outputPath, bool countSyscalls, measurement_t *measurement)
+{
+    int pipeDescriptors[2] = { -1, -1 };
+    pid_t feeder = -1;
+    if (piped && pipe(pipeDescriptors) == 0)
+    {
+        feeder = fork();
+        if (feeder == 0)
+        {
+            close(pipeDescriptors[0]);
+            feed(files, count, pipeDescriptors[1]);
+        }
+    }
+
+    double start = now();
+    pid_t child = fork();
+    if (child == 0)
+    {
+        int output = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(output, STDOUT_FILENO);
+        int discard = open("/dev/null", O_WRONLY);
+        dup2(discard, STDERR_FILENO);
+        if (piped) dup2(pipeDescriptors[0], STDIN_FILENO);
+        close(pipeDescriptors[0]);
+        close(pipeDescriptors[1]);
+
+        if (countSyscalls) ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        execvp(arguments[0], arguments);
+        _exit(127);
+    }
+    close(pipeDescriptors[0]);
+    close(pipeDescriptors[1]);
+
+    int status = 0;
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    measurement->syscalls = -1;
+    if (child > 0 && countSyscalls)
+    {
+        /* the child stops with SIGTRAP at its exec */
+        if (waitpid(child, &status, __WALL) == child && WIFSTOPPED(status)) measurement->syscalls = traceSyscalls(child, &status);
+    }
+    else if (child > 0) wait4(child, &status, 0, &usage);
+    measurement->seconds = now() - start;
+    measurement->maxRss = usage.ru_maxrss;
+    measurement->succeeded = child > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    if (feeder > 0) waitpid(feeder, NULL, 0);
+}
+
+/**
+ * @brief Compares two files byte by byte
+ *
+ * @param leftPath the first file
+ * @param rightPath the second file
+ * @return true if both files could be read and are equal
+ */
+static bool sameContent(const char *leftPath, const char *rightPath)
+{
+    FILE *left = fopen(leftPath, "r");
+    FILE *right = fopen(rightPath, "r");
+    char *leftBuffer = malloc(COPY_SIZE);
+    char *rightBuffer = malloc(COPY_SIZE);
+    bool same = left != NULL && right != NULL && leftBuffer != NULL && rightBuffer != NULL;
+
+    while (same)
+    {
+        size_t leftLength = fread(leftBuffer, 1, COPY_SIZE, left);
+        size_t rightLength = fread(rightBuffer, 1, COPY_SIZE, right);
+        same = leftLength == rightLength && memcmp(leftBuffer, rightBuffer, leftLength) == 0;
+        if (leftLength == 0) break;
+    }
+
+    if (left != NULL) fclose(left);
+    if (right != NULL) fclose(right);
+    free(leftBuffer);
+    free(rightBuffer);
+    return same;
+}
+
+int main(int argc, char *argv[])
+{
+    char *program = "./myexpand";
+    char *threads = "4";
+    int repetitions = 3;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:j:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm':
+                program = optarg;
+                break;
+            case 'j':
+                threads = optarg;
+                break;
+            case 'n':
+                repetitions = strtol(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "SYNOPSIS:\n   %s [-m myexpand] [-j threads] [-n repetitions] directory\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1 || repetitions < 1)
+    {
+        fprintf(stderr, "SYNOPSIS:\n   %s [-m myexpand] [-j threads] [-n repetitions] directory\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    char *directory = argv[optind];
+
+    char expectedPath[4096], outputPath[4096], statusPath[4096];
+    snprintf(expectedPath, sizeof(expectedPath), "%s/expected.out", directory);
+    snprintf(statusPath, sizeof(statusPath), "%s/status.out", directory);
+
+    printf("%-11s %-11s %10s %14s %12s %9s  %s\n", "input", "engine", "MB/s", "lines/s", "syscalls/MB", "RSS MB", "output");
+
+    size_t i, j;
+    for (i = 0; i < sizeof(INPUTS) / sizeof(INPUTS[0]); i++)
+    {
+        char *files[MAX_FILES];
+        int count = collectFiles(directory, INPUTS[i], files);
+        if (count <= 0)
+        {
+            fprintf(stderr, "[%s] ERROR: Could not read input %s in %s, run corpus first\n", argv[0], INPUTS[i], directory);
+            exit(EXIT_FAILURE);
+        }
+
+        double bytes, lines;
+        measureInput(files, count, &bytes, &lines);
+        bool haveExpected = false;
+
+        for (j = 0; j < sizeof(ENGINES) / sizeof(ENGINES[0]); j++)
+        {
+            const engine_t *engine = ENGINES + j;
+            if (engine->mode) haveExpected = false;
+
+            /* build the command line; myexpand writes data to -o, its status lines on stderr are dropped */
+            char *arguments[MAX_ARGUMENTS];
+            int argumentCount = 0;
+            const char *stdoutPath = statusPath;
+            snprintf(outputPath, sizeof(outputPath), "%s/%s.out", directory, engine->name);
+            if (engine->gnu != NULL)
+            {
+                arguments[argumentCount++] = (char *)engine->gnu;
+                if (engine->option != NULL) arguments[argumentCount++] = (char *)engine->option;
+                stdoutPath = outputPath;
+            }
+            else
+            {
+                arguments[argumentCount++] = program;
+                arguments[argumentCount++] = "-o";
+                arguments[argumentCount++] = outputPath;
+                if (engine->option != NULL) arguments[argumentCount++] = (char *)engine->option;
+                if (engine->threaded)
+                {
+                    arguments[argumentCount++] = "-j";
+                    arguments[argumentCount++] = threads;
+                }
+            }
+            int k;
+            for (k = 0; !engine->piped && k < count; k++) arguments[argumentCount++] = files[k];
+            arguments[argumentCount] = NULL;
+
+            /* best of the repetitions, then one traced run for the syscall count */
+            measurement_t best, current;
+            int repetition;
+            for (repetition = 0; repetition < repetitions; repetition++)
+            {
+                run(arguments, files, count, engine->piped, stdoutPath, false, &current);
+                if (repetition == 0 || current.seconds < best.seconds) best = current;
+            }
+            run(arguments, files, count, engine->piped, stdoutPath, true, &current);
+            if (!best.succeeded)
+            {
+                printf("%-11s %-11s %10s\n", INPUTS[i], engine->name, "failed");
+                continue;
+            }
+
+            /* the first successful engine of a mode (the GNU command if installed) defines the expected output */
+            const char *verdict = "expected";
+            if (!haveExpected) haveExpected = rename(outputPath, expectedPath) == 0;
+            else verdict = sameContent(expectedPath, outputPath) ? "match" : "DIFFERS";
+            unlink(outputPath);
+
+            double megabytes = bytes / (1 << 20);
+            if (current.syscalls >= 0)
+            {
+                printf("%-11s %-11s %10.1f %14.0f %12.1f %9.1f  %s\n", INPUTS[i], engine->name,
+                    megabytes / best.seconds, lines / best.seconds, current.syscalls / megabytes, best.maxRss / 1024.0, verdict);
+            }
+            else
+            {
+                printf("%-11s %-11s %10.1f %14.0f %12s %9.1f  %s\n", INPUTS[i], engine->name,
+                    megabytes / best.seconds, lines / best.seconds, "n/a", best.maxRss / 1024.0, verdict);
+            }
+            fflush(stdout);
+        }
+
+        unlink(expectedPath);
+        for (j = 0; j < (size_t)count; j++) free(files[j]);
+    }
+    unlink(statusPath);
+
+    return EXIT_SUCCESS;
+}
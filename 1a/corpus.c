@@ -0,0 +1,213 @@
+/**
+ * @file corpus.c
+ * @author Tobias Scharsching (12123692)
+ * @brief A program which generates a deterministic text corpus to benchmark myexpand with
+ * @date 2022-11-02
+ *
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <getopt.h>
+
+/**
+ * @brief Count of files in the directory of tiny files
+ */
+#define TINY_FILE_COUNT 2000
+
+/**
+ * @brief Maximal size of a tiny file, in bytes
+ */
+#define TINY_FILE_SIZE 2048
+
+/**
+ * @brief Multibyte characters the UTF-8 text is mixed with: 2, 3 and 4 byte sequences, wide and narrow
+ */
+static const char *const MULTIBYTE[] = { "\xc3\xa4", "\xe2\x82\xac", "\xe4\xb8\xad", "\xef\xbc\xa1", "\xf0\x9f\x98\x80" };
+
+/**
+ * @brief Parameters of one kind of text
+ */
+typedef struct text_kind {
+    const char *name; /** file name of the text */
+    size_t minLine; /** minimal line length, in characters */
+    size_t maxLine; /** maximal line length, in characters; 0 for a single line */
+    bool logLengths; /** line lengths are distributed logarithmically instead of uniformly */
+    unsigned tabsPerMille; /** probability of a tab per character */
+    unsigned multibytePerMille; /** probability of a multibyte character per character */
+} text_kind_t;
+
+/**
+ * @brief The generated texts
+ */
+static const text_kind_t KINDS[] = {
+    { "sparse.txt", 40, 120, false, 5, 0 },
+    { "dense.txt", 10, 80, false, 150, 0 },
+    { "mixed.txt", 0, 4096, true, 30, 0 },
+    { "giant.txt", 0, 0, false, 10, 0 },
+    { "utf8.txt", 20, 100, false, 40, 200 },
+};
+
+/**
+ * @brief Next value of a xorshift64* generator, so that the corpus is the same on every libc
+ *
+ * @param state the generator state, not 0
+ * @return a pseudo random value
+ */
+static uint64_t nextRandom(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Draws the length of the next line of a text
+ *
+ * @param kind the kind of text
+ * @param state the generator state
+ * @return the line length in characters
+ */
+static size_t lineLength(const text_kind_t *kind, uint64_t *state)
+{
+    size_t range = kind->maxLine - kind->minLine + 1;
+    if (!kind->logLengths) return kind->minLine + nextRandom(state) % range;
+
+    /* pick an order of magnitude first, then a length within it */
+    size_t limit = 1;
+    unsigned orders = nextRandom(state) % 13;
+    while (orders-- > 0 && limit < range) limit *= 2;
+    return kind->minLine + nextRandom(state) % limit;
+}
+
+/**
+ * @brief Writes text of a kind until a size is reached; the text always ends with a newline
+ *
+ * @param stream the stream to write to
+ * @param kind the kind of text
+ * @param size the minimal count of bytes to write
+ * @param state the generator state
+ * @return 0 on success, -1 if writing failed
+ */
+static int writeText(FILE *stream, const text_kind_t *kind, size_t size, uint64_t *state)
+{
+    size_t written = 0;
+    while (written < size)
+    {
+        size_t length = kind->maxLine == 0 ? size : lineLength(kind, state);
+        size_t i;
+        for (i = 0; i < length; i++)
+        {
+            unsigned draw = nextRandom(state) % 1000;
+            if (draw < kind->tabsPerMille)
+            {
+                putc('\t', stream);
+                written++;
+            }
+            else if (draw < kind->tabsPerMille + kind->multibytePerMille)
+            {
+                const char *character = MULTIBYTE[nextRandom(state) % (sizeof(MULTIBYTE) / sizeof(MULTIBYTE[0]))];
+                fputs(character, stream);
+                written += strlen(character);
+            }
+            else
+            {
+                /* words of letters separated by single spaces */
+                putc(draw % 7 == 0 ? ' ' : 'a' + draw % 26, stream);
+                written++;
+            }
+        }
+        putc('\n', stream);
+        written++;
+    }
+    return ferror(stream) ? -1 : 0;
+}
+
+/**
+ * @brief Writes one text file of the corpus
+ *
+ * @param path the path of the file
+ * @param kind the kind of text
+ * @param size the minimal size of the file
+ * @param seed the seed of the text
+ * @return 0 on success, -1 if the file could not be written
+ */
+static int writeFile(const char *path, const text_kind_t *kind, size_t size, uint64_t seed)
+{
+    FILE *stream = fopen(path, "w");
+    if (stream == NULL) return -1;
+
+    int success = writeText(stream, kind, size, &seed);
+    if (fclose(stream) == EOF) success = -1;
+    return success;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t megabytes = 32;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                megabytes = strtol(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "SYNOPSIS:\n   %s [-s megabytes] directory\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1 || megabytes < 1)
+    {
+        fprintf(stderr, "SYNOPSIS:\n   %s [-s megabytes] directory\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* create directories for the corpus and the tiny files */
+    char *directory = argv[optind];
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/tiny", directory);
+    if ((mkdir(directory, 0755) == -1 && errno != EEXIST) || (mkdir(path, 0755) == -1 && errno != EEXIST))
+    {
+        fprintf(stderr, "[%s] ERROR: Could not create %s: %s\n", argv[0], path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* one file per kind of text, each with its own seed */
+    size_t i;
+    for (i = 0; i < sizeof(KINDS) / sizeof(KINDS[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", directory, KINDS[i].name);
+        printf(" - writing %s\n", path);
+        if (writeFile(path, KINDS + i, megabytes << 20, 0x9E3779B97F4A7C15ULL + i) == -1)
+        {
+            fprintf(stderr, "[%s] ERROR: Could not write %s: %s\n", argv[0], path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* many tiny files with code like indentation */
+    text_kind_t tiny = { NULL, 0, 60, false, 80, 0 };
+    uint64_t seed = 0xD1B54A32D192ED03ULL;
+    printf(" - writing %d files to %s/tiny\n", TINY_FILE_COUNT, directory);
+    for (i = 0; i < TINY_FILE_COUNT; i++)
+    {
+        snprintf(path, sizeof(path), "%s/tiny/%04zu.txt", directory, i);
+        if (writeFile(path, &tiny, 1 + nextRandom(&seed) % TINY_FILE_SIZE, seed) == -1)
+        {
+            fprintf(stderr, "[%s] ERROR: Could not write %s: %s\n", argv[0], path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
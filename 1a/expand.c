@@ -0,0 +1,818 @@
+/**
+ * @file expand.c
+ * @author Tobias Scharsching (12123692)
+ * @brief A library which replaces tabs with spaces, fed with arbitrary byte spans
+ * @date 2022-11-02
+ *
+ * Instead of printing every character on its own, the input is scanned for
+ * tabs and newlines (16 or 32 bytes at a time where SSE2/AVX2 is available),
+ * the tab-free runs in between are copied in bulk into an output buffer and
+ * tabs are filled from a constant strip of spaces.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "expand.h"
+
+#define SPACES_16 "                "
+#define SPACES_64 SPACES_16 SPACES_16 SPACES_16 SPACES_16
+
+const char EXPAND_SPACE_STRIP[] = SPACES_64 SPACES_64;
+
+/* ----------       implementation of configuration and sinks       ---------- */
+
+uint64_t expandClock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void expandStatsAdd(expand_stats_t *total, const expand_stats_t *part)
+{
+    total->bytesIn += part->bytesIn;
+    total->bytesOut += part->bytesOut;
+    total->lines += part->lines;
+    total->tabs += part->tabs;
+    if (part->longestLine > total->longestLine) total->longestLine = part->longestLine;
+    total->reads += part->reads;
+    total->writes += part->writes;
+    total->ioNanoseconds += part->ioNanoseconds;
+    total->nanoseconds += part->nanoseconds;
+}
+
+void expandConfigInit(expand_config_t *config)
+{
+    config->tabSpaces = 8;
+    config->stops = NULL;
+    config->stopCount = 0;
+    config->repeatBase = 0;
+    config->repeatMask = 7;
+    config->repeatPowerOfTwo = true;
+    config->repeatStops = true;
+    config->unexpand = false;
+    config->utf8 = false;
+}
+
+/**
+ * @brief Parses the next column of a tab list
+ *
+ * @param list the position in the list, advanced past the column and its separator
+ * @param column the parsed column
+ * @param prefix the / or + in front of the column, 0 if there is none
+ * @return 0 on success, -1 if there is no valid column
+ */
+static int parseStop(const char **list, size_t *column, char *prefix)
+{
+    const char *position = *list;
+    *prefix = 0;
+    if (*position == '/' || *position == '+') *prefix = *position++;
+    if (*position < '0' || *position > '9') return -1;
+
+    size_t value = 0;
+    while (*position >= '0' && *position <= '9')
+    {
+        value = value * 10 + (*position++ - '0');
+        if (value > EXPAND_STOP_LIMIT) return -1;
+    }
+    if (*position == ',' || *position == ' ' || *position == '\t') position++;
+    else if (*position != '\0') return -1;
+
+    *column = value;
+    *list = position;
+    return 0;
+}
+
+int expandConfigStops(expand_config_t *config, const char *list)
+{
+    size_t columns[EXPAND_STOP_LIST_SIZE];
+    size_t count = 0;
+    size_t column;
+    char prefix = 0;
+
+    /* collect the ascending stops, only the last one may have a prefix */
+    while (*list != '\0')
+    {
+        if (prefix != 0 || count == EXPAND_STOP_LIST_SIZE || parseStop(&list, &column, &prefix) == -1) return -1;
+        if (column == 0 || (count > 0 && column <= columns[count - 1] && prefix == 0)) return -1;
+        if (prefix == 0) columns[count++] = column;
+    }
+    if (count == 0 && prefix == 0) return -1;
+
+    expandConfigFree(config);
+    config->repeatBase = 0;
+    config->repeatStops = true;
+    if (prefix != 0)
+    {
+        /* the stops after the list repeat from 0 or from the last listed stop */
+        config->tabSpaces = column;
+        if (prefix == '+' && count > 0) config->repeatBase = columns[count - 1];
+    }
+    else if (count == 1)
+    {
+        /* a single value is the distance between all stops */
+        config->tabSpaces = columns[0];
+        count = 0;
+    }
+    else
+    {
+        /* after the list, a tab is a single space */
+        config->tabSpaces = 1;
+        config->repeatBase = columns[count - 1];
+        config->repeatStops = false;
+    }
+    config->repeatPowerOfTwo = (config->tabSpaces & (config->tabSpaces - 1)) == 0;
+    config->repeatMask = config->tabSpaces - 1;
+
+    if (count == 0) return 0;
+
+    /* every column before the last stop looks up its next stop */
+    config->stops = malloc(columns[count - 1] * sizeof(uint32_t));
+    if (config->stops == NULL) return -1;
+    config->stopCount = columns[count - 1];
+    size_t i, stop = 0;
+    for (i = 0; i < config->stopCount; i++)
+    {
+        if (i >= columns[stop]) stop++;
+        config->stops[i] = columns[stop];
+    }
+    return 0;
+}
+
+void expandConfigFree(expand_config_t *config)
+{
+    free(config->stops);
+    config->stops = NULL;
+    config->stopCount = 0;
+}
+
+/**
+ * @brief Write function of stream sinks
+ *
+ * @param target the stream
+ * @param data the bytes to write
+ * @param length count of bytes to write
+ * @return 0 on success, -1 if the stream could not be written
+ */
+static int writeStream(void *target, const char *data, size_t length)
+{
+    return fwrite(data, 1, length, target) == length ? 0 : -1;
+}
+
+/**
+ * @brief Write function of file descriptor sinks, continues after partial writes
+ *
+ * @param target the file descriptor, stored in the pointer
+ * @param data the bytes to write
+ * @param length count of bytes to write
+ * @return 0 on success, -1 if the file descriptor could not be written
+ */
+static int writeDescriptor(void *target, const char *data, size_t length)
+{
+    int descriptor = (int)(intptr_t)target;
+    while (length > 0)
+    {
+        ssize_t written = write(descriptor, data, length);
+        if (written == -1 && errno == EINTR) continue;
+        if (written == -1) return -1;
+
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+/**
+ * @brief Write function of memory sinks, grows the buffer by doubling
+ *
+ * @param target the memory buffer
+ * @param data the bytes to append
+ * @param length count of bytes to append
+ * @return 0 on success, -1 if the buffer could not be grown
+ */
+static int writeMemory(void *target, const char *data, size_t length)
+{
+    expand_memory_t *memory = target;
+    if (length > memory->capacity - memory->length)
+    {
+        size_t capacity = memory->capacity == 0 ? EXPAND_BUFFER_SIZE : memory->capacity;
+        while (length > capacity - memory->length) capacity *= 2;
+
+        char *grown = realloc(memory->data, capacity);
+        if (grown == NULL) return -1;
+        memory->data = grown;
+        memory->capacity = capacity;
+    }
+
+    memcpy(memory->data + memory->length, data, length);
+    memory->length += length;
+    return 0;
+}
+
+expand_sink_t expandSinkStream(FILE *stream)
+{
+    expand_sink_t sink = { writeStream, stream };
+    return sink;
+}
+
+expand_sink_t expandSinkDescriptor(int descriptor)
+{
+    expand_sink_t sink = { writeDescriptor, (void *)(intptr_t)descriptor };
+    return sink;
+}
+
+expand_sink_t expandSinkMemory(expand_memory_t *memory)
+{
+    expand_sink_t sink = { writeMemory, memory };
+    return sink;
+}
+
+/* ----------       implementation of the incremental expander       ---------- */
+
+struct expander {
+    expand_state_t state; /** column and configuration */
+    expand_output_t output; /** buffered output and sink */
+};
+
+expander_t *expanderCreate(const expand_config_t *config, expand_sink_t sink)
+{
+    expander_t *expander = malloc(sizeof(expander_t));
+    if (expander == NULL) return NULL;
+
+    expandStateInit(&expander->state, config);
+    expandOutputInit(&expander->output, sink, &expander->state.stats);
+    return expander;
+}
+
+int expanderFeed(expander_t *expander, const char *data, size_t length)
+{
+    return expandBlock(&expander->state, data, length, &expander->output);
+}
+
+int expanderFlush(expander_t *expander)
+{
+    if (expandFinish(&expander->state, &expander->output) == -1) return -1;
+    return expandOutputFlush(&expander->output);
+}
+
+void expanderReset(expander_t *expander)
+{
+    expandStateInit(&expander->state, expander->state.config);
+}
+
+const expand_stats_t *expanderStats(const expander_t *expander)
+{
+    return &expander->state.stats;
+}
+
+void expanderDestroy(expander_t *expander)
+{
+    free(expander);
+}
+
+/* ----------       implementation of the block engine       ---------- */
+
+void expandStateInit(expand_state_t *state, const expand_config_t *config)
+{
+    state->config = config;
+    state->column = 0;
+    state->codePoint = 0;
+    state->pending = 0;
+    state->spaces = 0;
+    state->spaceAtStop = false;
+    state->blank = true;
+    state->lineLength = 0;
+    memset(&state->stats, 0, sizeof(expand_stats_t));
+}
+
+void expandOutputInit(expand_output_t *output, expand_sink_t sink, expand_stats_t *stats)
+{
+    output->sink = sink;
+    output->used = 0;
+    output->data = output->buffer;
+    output->stats = stats;
+}
+
+/**
+ * @brief Writes data to the sink of an output buffer and counts the write
+ *
+ * @param output the output buffer
+ * @param data the bytes to write
+ * @param length count of bytes to write
+ * @return 0 on success, -1 if the sink failed
+ */
+static int writeSink(expand_output_t *output, const char *data, size_t length)
+{
+    if (output->stats == NULL) return output->sink.write(output->sink.target, data, length);
+
+    uint64_t start = expandClock();
+    int success = output->sink.write(output->sink.target, data, length);
+    output->stats->ioNanoseconds += expandClock() - start;
+    output->stats->writes++;
+    output->stats->bytesOut += length;
+    return success;
+}
+
+int expandOutputFlush(expand_output_t *output)
+{
+    if (output->used > 0 && writeSink(output, output->data, output->used) == -1) return -1;
+    output->used = 0;
+    return 0;
+}
+
+/**
+ * @brief Appends bytes to an output buffer, flushing it if they don't fit
+ * @details
+ * Data that is at least as big as the whole buffer is written to the sink directly.
+ *
+ * @param output the output buffer
+ * @param data the bytes to append
+ * @param length count of bytes to append
+ * @return 0 on success, -1 if the sink failed
+ */
+static int appendBytes(expand_output_t *output, const char *data, size_t length)
+{
+    if (length > EXPAND_BUFFER_SIZE - output->used)
+    {
+        if (expandOutputFlush(output) == -1) return -1;
+
+        if (length >= EXPAND_BUFFER_SIZE)
+        {
+            return writeSink(output, data, length);
+        }
+    }
+
+    memcpy(output->data + output->used, data, length);
+    output->used += length;
+    return 0;
+}
+
+/**
+ * @brief Appends spaces to an output buffer
+ *
+ * @param output the output buffer
+ * @param count count of spaces to append
+ * @return 0 on success, -1 if the sink failed
+ */
+static int appendSpaces(expand_output_t *output, size_t count)
+{
+    while (count > 0)
+    {
+        size_t length = count < EXPAND_SPACE_STRIP_SIZE ? count : EXPAND_SPACE_STRIP_SIZE;
+        if (appendBytes(output, EXPAND_SPACE_STRIP, length) == -1) return -1;
+        count -= length;
+    }
+    return 0;
+}
+
+const char *expandFindSpecial(const char *begin, const char *end)
+{
+#if defined(__AVX2__)
+    const __m256i tabs32 = _mm256_set1_epi8('\t');
+    const __m256i newlines32 = _mm256_set1_epi8('\n');
+    while (end - begin >= 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)begin);
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, tabs32), _mm256_cmpeq_epi8(block, newlines32)));
+        if (mask != 0) return begin + __builtin_ctz(mask);
+        begin += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i tabs = _mm_set1_epi8('\t');
+    const __m128i newlines = _mm_set1_epi8('\n');
+    while (end - begin >= 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)begin);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, tabs), _mm_cmpeq_epi8(block, newlines)));
+        if (mask != 0) return begin + __builtin_ctz(mask);
+        begin += 16;
+    }
+#endif
+
+    /* scalar tail (or whole block without SIMD) */
+    while (begin < end && *begin != '\t' && *begin != '\n') begin++;
+    return begin;
+}
+
+/**
+ * @brief Finds the next space, tab or newline in a block of bytes
+ *
+ * @param begin the first byte to scan
+ * @param end one past the last byte to scan
+ * @return pointer to the first blank or newline, or end if there is none
+ */
+static const char *findBlank(const char *begin, const char *end)
+{
+#if defined(__AVX2__)
+    const __m256i spaces32 = _mm256_set1_epi8(' ');
+    const __m256i tabs32 = _mm256_set1_epi8('\t');
+    const __m256i newlines32 = _mm256_set1_epi8('\n');
+    while (end - begin >= 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)begin);
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, spaces32),
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, tabs32), _mm256_cmpeq_epi8(block, newlines32))));
+        if (mask != 0) return begin + __builtin_ctz(mask);
+        begin += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i tabs = _mm_set1_epi8('\t');
+    const __m128i newlines = _mm_set1_epi8('\n');
+    while (end - begin >= 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)begin);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, spaces),
+            _mm_or_si128(_mm_cmpeq_epi8(block, tabs), _mm_cmpeq_epi8(block, newlines))));
+        if (mask != 0) return begin + __builtin_ctz(mask);
+        begin += 16;
+    }
+#endif
+
+    while (begin < end && *begin != ' ' && *begin != '\t' && *begin != '\n') begin++;
+    return begin;
+}
+
+/**
+ * @brief Finds the first byte with the high bit set, i.e. the first byte that is not ASCII
+ *
+ * @param begin the first byte to scan
+ * @param end one past the last byte to scan
+ * @return pointer to the first non ASCII byte, or end if there is none
+ */
+static const unsigned char *findHighByte(const unsigned char *begin, const unsigned char *end)
+{
+#if defined(__AVX2__)
+    while (end - begin >= 32)
+    {
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)begin));
+        if (mask != 0) return begin + __builtin_ctz(mask);
+        begin += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    while (end - begin >= 16)
+    {
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)begin));
+        if (mask != 0) return begin + __builtin_ctz(mask);
+        begin += 16;
+    }
+#endif
+
+    while (begin < end && *begin < 0x80) begin++;
+    return begin;
+}
+
+/**
+ * @brief Checks if a code point is an East Asian wide or fullwidth character
+ *
+ * @param codePoint the code point
+ * @return true if the character takes two columns
+ */
+static bool isWide(uint32_t codePoint)
+{
+    static const uint32_t ranges[][2] = {
+        { 0x1100, 0x115F }, { 0x2329, 0x232A }, { 0x2E80, 0x303E }, { 0x3041, 0x33FF },
+        { 0x3400, 0x4DBF }, { 0x4E00, 0x9FFF }, { 0xA000, 0xA4CF }, { 0xAC00, 0xD7A3 },
+        { 0xF900, 0xFAFF }, { 0xFE10, 0xFE19 }, { 0xFE30, 0xFE6F }, { 0xFF00, 0xFF60 },
+        { 0xFFE0, 0xFFE6 }, { 0x1F300, 0x1F64F }, { 0x1F900, 0x1F9FF }, { 0x20000, 0x2FFFD },
+        { 0x30000, 0x3FFFD },
+    };
+
+    if (codePoint < ranges[0][0]) return false;
+    size_t i;
+    for (i = 0; i < sizeof(ranges) / sizeof(ranges[0]) && codePoint >= ranges[i][0]; i++)
+    {
+        if (codePoint <= ranges[i][1]) return true;
+    }
+    return false;
+}
+
+size_t expandDisplayWidth(expand_state_t *state, const char *begin, const char *special, const char *end)
+{
+    const unsigned char *input = (const unsigned char *)begin;
+    const unsigned char *stop = (const unsigned char *)special;
+    size_t width = 0;
+
+    while (input < stop)
+    {
+        /* continuation bytes complete the current sequence; its first column was counted at the lead byte */
+        if (state->pending > 0)
+        {
+            if ((*input & 0xC0) != 0x80)
+            {
+                state->pending = 0;
+                continue;
+            }
+            state->codePoint = (state->codePoint << 6) | (*input++ & 0x3F);
+            if (--state->pending == 0 && isWide(state->codePoint)) width++;
+            continue;
+        }
+
+        /* ASCII is one column per byte */
+        const unsigned char *high = findHighByte(input, stop);
+        width += high - input;
+        input = high;
+        if (input == stop) break;
+
+        unsigned char lead = *input++;
+        width++;
+        if (lead >= 0xF8 || lead < 0xC0)
+        {
+            /* stray continuation byte or invalid lead byte */
+        }
+        else if (lead >= 0xF0)
+        {
+            state->codePoint = lead & 0x07;
+            state->pending = 3;
+        }
+        else if (lead >= 0xE0)
+        {
+            state->codePoint = lead & 0x0F;
+            state->pending = 2;
+        }
+        else
+        {
+            state->codePoint = lead & 0x1F;
+            state->pending = 1;
+        }
+    }
+
+    /* only the end of the block may split a sequence, a tab or newline cuts it off */
+    if (special != end) state->pending = 0;
+    return width;
+}
+
+/**
+ * @brief Computes the tab stop after a column for unexpansion
+ *
+ * @param state the expansion state that holds the configuration
+ * @param column the current column
+ * @return the column of the next tab stop, SIZE_MAX after the last stop of a tab list without repeat
+ */
+static size_t unexpandNextStop(const expand_state_t *state, size_t column)
+{
+    if (!state->config->repeatStops && column >= state->config->stopCount) return SIZE_MAX;
+    return expandNextStop(state, column);
+}
+
+/**
+ * @brief Writes the spaces that an unexpansion holds back, because a non-blank follows them
+ *
+ * @param state the expansion state
+ * @param output the output buffer
+ * @return 0 on success, -1 if the sink failed
+ */
+static int releaseSpaces(expand_state_t *state, expand_output_t *output)
+{
+    if (state->spaces > 0 && appendSpaces(output, state->spaces) == -1) return -1;
+    state->spaces = 0;
+    state->spaceAtStop = false;
+    return 0;
+}
+
+/**
+ * @brief Writes a tab for a pending single space at a stop, because another blank follows it
+ *
+ * @param state the expansion state
+ * @param output the output buffer
+ * @return 0 on success, -1 if the sink failed
+ */
+static int resolveSpaceAtStop(expand_state_t *state, expand_output_t *output)
+{
+    if (!state->spaceAtStop) return 0;
+    state->spaces = 0;
+    state->spaceAtStop = false;
+    state->stats.tabs++;
+    return appendBytes(output, "\t", 1);
+}
+
+/**
+ * @brief Replaces runs of blanks that reach tab stops with tabs and appends the result to an output buffer
+ * @details
+ * Spaces are held back in the state until it is known if they reach a stop. As unexpand does,
+ * a single space that reaches a stop right after a non-blank only becomes a tab if another
+ * blank follows it.
+ *
+ * @param state the expansion state, updated after the block
+ * @param input the bytes to unexpand
+ * @param length count of bytes in input
+ * @param output the output buffer to append to
+ * @return 0 on success, -1 if the output could not be written
+ */
+static int unexpandBlock(expand_state_t *state, const char *input, size_t length, expand_output_t *output)
+{
+    const char *end = input + length;
+    const char *line = input;
+
+    while (input < end)
+    {
+        /* text between blanks is copied in one piece, after the spaces held back before it */
+        const char *special = findBlank(input, end);
+        size_t run = special - input;
+        if (run > 0 && (releaseSpaces(state, output) == -1 || appendBytes(output, input, run) == -1)) return -1;
+        state->column += expandRunWidth(state, input, special, end);
+        if (run > 0) state->blank = false;
+
+        if (special == end) break;
+
+        if (*special == '\n')
+        {
+            if (releaseSpaces(state, output) == -1 || appendBytes(output, "\n", 1) == -1) return -1;
+            expandCountLine(state, special - line);
+            state->column = 0;
+            state->blank = true;
+            input = line = special + 1;
+        }
+        else if (*special == '\t')
+        {
+            /* a tab covers the spaces before it, unless it is only a single space after the last stop */
+            if (unexpandNextStop(state, state->column) == SIZE_MAX && releaseSpaces(state, output) == -1) return -1;
+            if (resolveSpaceAtStop(state, output) == -1 || appendBytes(output, "\t", 1) == -1) return -1;
+            state->spaces = 0;
+            state->column = expandNextStop(state, state->column);
+            state->blank = true;
+            state->stats.tabs++;
+            input = special + 1;
+        }
+        else
+        {
+            /* walk the run of spaces from stop to stop */
+            const char *last = special;
+            while (last < end && *last == ' ') last++;
+            size_t count = last - special;
+            while (count > 0)
+            {
+                /* after the last stop, a single space at it stays a space */
+                size_t stop = unexpandNextStop(state, state->column);
+                if ((stop == SIZE_MAX ? releaseSpaces(state, output) : resolveSpaceAtStop(state, output)) == -1) return -1;
+
+                size_t distance = stop - state->column;
+                if (distance > count)
+                {
+                    state->spaces += count;
+                    state->column += count;
+                    break;
+                }
+
+                count -= distance;
+                state->spaces += distance;
+                state->column += distance;
+                if (state->spaces == 1 && !state->blank) state->spaceAtStop = true;
+                else
+                {
+                    if (appendBytes(output, "\t", 1) == -1) return -1;
+                    state->spaces = 0;
+                    state->stats.tabs++;
+                }
+                state->blank = true;
+            }
+            state->blank = true;
+            input = last;
+        }
+    }
+
+    state->lineLength += end - line;
+    return 0;
+}
+
+int expandFinish(expand_state_t *state, expand_output_t *output)
+{
+    if (state->lineLength > state->stats.longestLine) state->stats.longestLine = state->lineLength;
+    return releaseSpaces(state, output);
+}
+
+int expandBlock(expand_state_t *state, const char *input, size_t length, expand_output_t *output)
+{
+    state->stats.bytesIn += length;
+    if (state->config->unexpand) return unexpandBlock(state, input, length, output);
+
+    const char *end = input + length;
+    const char *line = input;
+    size_t position = state->column;
+
+    while (input < end)
+    {
+        /* copy the run up to the next tab or newline in one piece */
+        const char *special = expandFindSpecial(input, end);
+        size_t run = special - input;
+        if (run > 0 && appendBytes(output, input, run) == -1) return -1;
+        position += expandRunWidth(state, input, special, end);
+
+        if (special == end) break;
+
+        /* newline resets the column, tab pads up to the next stop */
+        if (*special == '\n')
+        {
+            if (appendBytes(output, "\n", 1) == -1) return -1;
+            expandCountLine(state, special - line);
+            line = special + 1;
+            position = 0;
+        }
+        else
+        {
+            size_t newPosition = expandNextStop(state, position);
+            if (appendSpaces(output, newPosition - position) == -1) return -1;
+            state->stats.tabs++;
+            position = newPosition;
+        }
+
+        input = special + 1;
+    }
+
+    state->lineLength += end - line;
+    state->column = position;
+    return 0;
+}
+
+size_t expandMeasure(expand_state_t *state, const char *input, size_t length)
+{
+    const char *end = input + length;
+    size_t position = state->column;
+    size_t total = 0;
+
+    while (input < end)
+    {
+        const char *special = expandFindSpecial(input, end);
+        size_t run = special - input;
+        total += run;
+        position += expandRunWidth(state, input, special, end);
+
+        if (special == end) break;
+
+        if (*special == '\n')
+        {
+            total++;
+            position = 0;
+        }
+        else
+        {
+            size_t newPosition = expandNextStop(state, position);
+            total += newPosition - position;
+            position = newPosition;
+        }
+
+        input = special + 1;
+    }
+
+    state->column = position;
+    return total;
+}
+
+int expandStream(FILE *inputStream, const expand_config_t *config, expand_sink_t sink, expand_stats_t *stats)
+{
+    uint64_t start = expandClock();
+    expand_output_t *output = malloc(sizeof(expand_output_t));
+    char *chunk = malloc(EXPAND_CHUNK_SIZE);
+    if (output == NULL || chunk == NULL)
+    {
+        free(output);
+        free(chunk);
+        return -1;
+    }
+
+    expand_state_t state;
+    expandStateInit(&state, config);
+    expandOutputInit(output, sink, &state.stats);
+
+    /* read fixed size chunks; lines may span any number of them */
+    int descriptor = fileno(inputStream);
+    int success = 0;
+    while (success == 0)
+    {
+        uint64_t readStart = expandClock();
+        ssize_t length = read(descriptor, chunk, EXPAND_CHUNK_SIZE);
+        state.stats.ioNanoseconds += expandClock() - readStart;
+        state.stats.reads++;
+        if (length == -1 && errno == EINTR) continue;
+        if (length == -1) success = -1;
+        if (length <= 0) break;
+
+        success = expandBlock(&state, chunk, length, output);
+    }
+    if (success == 0) success = expandFinish(&state, output);
+
+    if (expandOutputFlush(output) == -1) success = -1;
+
+    state.stats.nanoseconds = expandClock() - start;
+    if (stats != NULL) *stats = state.stats;
+    free(chunk);
+    free(output);
+    return success;
+}
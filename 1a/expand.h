@@ -0,0 +1,424 @@
+/**
+ * @file expand.h
+ * @author Tobias Scharsching (12123692)
+ * @brief A library which replaces tabs with spaces, fed with arbitrary byte spans
+ * @date 2022-11-02
+ *
+ * Usage:
+ *      expand_config_t config;
+ *      expandConfigInit(&config);
+ *      expander_t *expander = expanderCreate(&config, expandSinkStream(stdout));
+ *      expanderFeed(expander, data, length);    (any number of times)
+ *      expanderFlush(expander);
+ *      expanderDestroy(expander);
+ *
+ * Link with libexpand.a.
+ */
+
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+/* ----------       define constants        ---------- */
+
+/**
+ * @brief The size of the output buffer that expanded text is collected in before it is written, in bytes
+ */
+#define EXPAND_BUFFER_SIZE (1 << 16)
+
+/**
+ * @brief The size of the chunks that a stream is read in, in bytes
+ */
+#define EXPAND_CHUNK_SIZE (1 << 16)
+
+/**
+ * @brief Maximal count of stops in a tab list
+ */
+#define EXPAND_STOP_LIST_SIZE 1024
+
+/**
+ * @brief Maximal column of the last stop of a tab list, bounds the size of its lookup table
+ */
+#define EXPAND_STOP_LIMIT (1 << 20)
+
+/**
+ * @brief The count of spaces in the space strip
+ */
+#define EXPAND_SPACE_STRIP_SIZE 128
+
+/**
+ * @brief A constant strip of EXPAND_SPACE_STRIP_SIZE spaces that tab padding is taken from
+ */
+extern const char EXPAND_SPACE_STRIP[];
+
+/* ----------       defines of configuration and sinks       ---------- */
+
+/**
+ * @brief Configuration of an expansion, shared by all states that expand with it
+ */
+typedef struct expand_config {
+    int tabSpaces; /** distance between two tab stops, or between the stops after a tab list */
+    uint32_t *stops; /** next stop for every column before the last stop of a tab list, NULL without a list */
+    size_t stopCount; /** count of entries in stops, i.e. the column of the last listed stop */
+    size_t repeatBase; /** column that the stops after the list are counted from */
+    size_t repeatMask; /** tabSpaces - 1 if tabSpaces is a power of two */
+    bool repeatPowerOfTwo; /** tabSpaces is a power of two, so the next stop is found with a mask */
+    bool repeatStops; /** stops continue after a tab list; if not, a tab after the list is a single space */
+    bool unexpand; /** runs of blanks that reach tab stops are replaced with tabs, instead of the reverse */
+    bool utf8; /** columns count UTF-8 characters by display width instead of bytes */
+} expand_config_t;
+
+/**
+ * @brief Function that takes buffered output and writes it to its target
+ *
+ * @param target the target of the sink
+ * @param data the bytes to write
+ * @param length count of bytes to write
+ * @return 0 on success, -1 if the data could not be written completely
+ */
+typedef int (*expand_write_t)(void *target, const char *data, size_t length);
+
+/**
+ * @brief A destination for expanded output
+ */
+typedef struct expand_sink {
+    expand_write_t write; /** function that takes the output */
+    void *target; /** passed to write, e.g. a stream */
+} expand_sink_t;
+
+/**
+ * @brief A growing memory buffer that a memory sink appends to, owned by the caller
+ */
+typedef struct expand_memory {
+    char *data; /** the buffer, may be NULL initially; reallocated when full */
+    size_t length; /** count of bytes in the buffer */
+    size_t capacity; /** allocated size of the buffer */
+} expand_memory_t;
+
+/**
+ * @brief Counters of an expansion; they are always kept, as they cost a few increments per line
+ */
+typedef struct expand_stats {
+    uint64_t bytesIn; /** count of input bytes */
+    uint64_t bytesOut; /** count of output bytes */
+    uint64_t lines; /** count of newlines */
+    uint64_t tabs; /** count of tabs expanded, or written when unexpanding */
+    uint64_t longestLine; /** length of the longest line in input bytes, without the newline */
+    uint64_t reads; /** count of read calls on the input */
+    uint64_t writes; /** count of write calls on the output, or of sink writes */
+    uint64_t ioNanoseconds; /** time spent in or waiting for reads and writes */
+    uint64_t nanoseconds; /** total time of the expansion */
+} expand_stats_t;
+
+/**
+ * @brief Reads the monotonic clock
+ *
+ * @return the time in nanoseconds, from an arbitrary start
+ */
+uint64_t expandClock(void);
+
+/**
+ * @brief Adds the counters of one expansion to a total; the longest line is the maximum of both
+ *
+ * @param total the total to add to
+ * @param part the counters to add
+ */
+void expandStatsAdd(expand_stats_t *total, const expand_stats_t *part);
+
+/**
+ * @brief Initializes a configuration with the defaults (tab stops every 8 columns, byte columns)
+ *
+ * @param config the configuration
+ */
+void expandConfigInit(expand_config_t *config);
+
+/**
+ * @brief Sets the tab stops of a configuration from a list like the one of expand -t
+ * @details
+ * The list is either a single distance between all stops, or ascending stop columns
+ * separated by commas or blanks. The last entry may be prefixed with / for stops at
+ * multiples of its value after the list, or with + for stops at that distance from the
+ * last listed one; without a prefix, tabs after the last stop become single spaces.
+ * The stops are compiled into a lookup table of the next stop for every column.
+ *
+ * @param config the configuration, release it with expandConfigFree
+ * @param list the tab list, e.g. "4", "4,12,20" or "2,4,/8"
+ * @return 0 on success, -1 if the list is invalid or the table could not be allocated
+ */
+int expandConfigStops(expand_config_t *config, const char *list);
+
+/**
+ * @brief Releases the tab stop table of a configuration
+ *
+ * @param config the configuration
+ */
+void expandConfigFree(expand_config_t *config);
+
+/**
+ * @brief Creates a sink that writes to a stream
+ *
+ * @param stream the stream
+ * @return the sink
+ */
+expand_sink_t expandSinkStream(FILE *stream);
+
+/**
+ * @brief Creates a sink that writes to a file descriptor with write
+ *
+ * @param descriptor the file descriptor
+ * @return the sink
+ */
+expand_sink_t expandSinkDescriptor(int descriptor);
+
+/**
+ * @brief Creates a sink that appends to a memory buffer
+ *
+ * @param memory the memory buffer; free data when done
+ * @return the sink
+ */
+expand_sink_t expandSinkMemory(expand_memory_t *memory);
+
+/* ----------       defines of the incremental expander       ---------- */
+
+/**
+ * @brief An expansion in progress, which takes input spans and writes to a sink
+ */
+typedef struct expander expander_t;
+
+/**
+ * @brief Creates an expander at the start of a line
+ *
+ * @param config the configuration, has to live as long as the expander
+ * @param sink the sink that receives the output
+ * @return the expander, NULL if it could not be allocated
+ */
+expander_t *expanderCreate(const expand_config_t *config, expand_sink_t sink);
+
+/**
+ * @brief Expands a span of input
+ * @details
+ * Spans may end anywhere, also inside a line. Output is buffered and only
+ * written to the sink when the buffer is full or the expander is flushed.
+ *
+ * @param expander the expander
+ * @param data the input bytes
+ * @param length count of bytes
+ * @return 0 on success, -1 if the sink failed
+ */
+int expanderFeed(expander_t *expander, const char *data, size_t length);
+
+/**
+ * @brief Writes all buffered output to the sink
+ *
+ * @param expander the expander
+ * @return 0 on success, -1 if the sink failed
+ */
+int expanderFlush(expander_t *expander);
+
+/**
+ * @brief Starts a new input at the start of a line, e.g. for the next file
+ *
+ * @param expander the expander
+ */
+void expanderReset(expander_t *expander);
+
+/**
+ * @brief Returns the counters of an expander since it was created or reset
+ * @details
+ * Writes are counted as sink writes; no reads are counted as the expander does not read.
+ *
+ * @param expander the expander
+ * @return the counters, valid until the expander is destroyed
+ */
+const expand_stats_t *expanderStats(const expander_t *expander);
+
+/**
+ * @brief Releases an expander; buffered output that was not flushed is dropped
+ *
+ * @param expander the expander
+ */
+void expanderDestroy(expander_t *expander);
+
+/* ----------       defines of the block engine       ---------- */
+
+/**
+ * @brief State of an expansion that is carried from one block to the next
+ */
+typedef struct expand_state {
+    const expand_config_t *config; /** the configuration */
+    size_t column; /** output column of the next byte, 0 at line start */
+    uint32_t codePoint; /** bits of a UTF-8 sequence that was split between blocks */
+    int pending; /** count of continuation bytes the split sequence still needs */
+    size_t spaces; /** unexpand: count of spaces before column that are not written yet */
+    bool spaceAtStop; /** unexpand: the single pending space reached a stop, it becomes a tab if a blank follows */
+    bool blank; /** unexpand: the last byte was a space or a tab, or the line just started */
+    size_t lineLength; /** input bytes of the current line in earlier blocks */
+    expand_stats_t stats; /** counters of the expansion */
+} expand_state_t;
+
+/**
+ * @brief Buffer that collects expanded text and writes it to its sink when full
+ */
+typedef struct expand_output {
+    expand_sink_t sink; /** sink the buffer is flushed to */
+    size_t used; /** count of bytes currently held in the buffer */
+    char *data; /** buffer that is currently filled, EXPAND_BUFFER_SIZE bytes; the sink may exchange it */
+    expand_stats_t *stats; /** counters that sink writes are added to, NULL if the caller counts them itself */
+    char buffer[EXPAND_BUFFER_SIZE]; /** own buffer memory */
+} expand_output_t;
+
+/**
+ * @brief Initializes an expansion state at the start of a line
+ *
+ * @param state the state to initialize
+ * @param config the configuration, has to live as long as the state
+ */
+void expandStateInit(expand_state_t *state, const expand_config_t *config);
+
+/**
+ * @brief Computes the column of the tab stop after a column
+ *
+ * @param state the expansion state that holds the configuration
+ * @param column the current column
+ * @return the column of the next tab stop
+ */
+static inline size_t expandNextStop(const expand_state_t *state, size_t column)
+{
+    const expand_config_t *config = state->config;
+    if (column < config->stopCount) return config->stops[column];
+
+    size_t offset = column - config->repeatBase;
+    if (config->repeatPowerOfTwo) return config->repeatBase + (offset | config->repeatMask) + 1;
+    return column + config->tabSpaces - offset % config->tabSpaces;
+}
+
+/**
+ * @brief Counts a newline in the statistics of a state
+ *
+ * @param state the expansion state
+ * @param length input bytes of the line in the current block, without the newline
+ */
+static inline void expandCountLine(expand_state_t *state, size_t length)
+{
+    length += state->lineLength;
+    if (length > state->stats.longestLine) state->stats.longestLine = length;
+    state->stats.lines++;
+    state->lineLength = 0;
+}
+
+/**
+ * @brief Initializes an output buffer for a sink
+ *
+ * @param output the output buffer
+ * @param sink the sink that the buffered data is written to
+ * @param stats counters that the sink writes are added to, NULL to not count them
+ */
+void expandOutputInit(expand_output_t *output, expand_sink_t sink, expand_stats_t *stats);
+
+/**
+ * @brief Writes all buffered data to the sink of the output buffer
+ *
+ * @param output the output buffer
+ * @return 0 on success, -1 if the sink failed
+ */
+int expandOutputFlush(expand_output_t *output);
+
+/**
+ * @brief Finds the next tab or newline in a block of bytes
+ *
+ * @param begin the first byte to scan
+ * @param end one past the last byte to scan
+ * @return pointer to the first tab or newline, or end if there is none
+ */
+const char *expandFindSpecial(const char *begin, const char *end);
+
+/**
+ * @brief Computes the display width of a run of UTF-8 text without tabs and newlines
+ * @details
+ * Every character is one column wide, East Asian wide characters two; invalid bytes count
+ * one column each. Pure ASCII is counted 16 or 32 bytes at a time and only blocks that
+ * contain high bytes go through the decoder. A sequence that is cut off by the end of the
+ * block is kept in the state and completed with the next block.
+ *
+ * @param state the expansion state, holds a sequence split between blocks
+ * @param begin the first byte of the run
+ * @param special one past the last byte of the run, the tab or newline that ends it
+ * @param end the end of the block that the run is part of
+ * @return the count of columns of the run
+ */
+size_t expandDisplayWidth(expand_state_t *state, const char *begin, const char *special, const char *end);
+
+/**
+ * @brief Computes the count of columns of a run without tabs and newlines
+ *
+ * @param state the expansion state
+ * @param begin the first byte of the run
+ * @param special one past the last byte of the run
+ * @param end the end of the block that the run is part of
+ * @return the count of columns of the run, its length in bytes unless UTF-8 columns are configured
+ */
+static inline size_t expandRunWidth(expand_state_t *state, const char *begin, const char *special, const char *end)
+{
+    if (!state->config->utf8) return special - begin;
+    return expandDisplayWidth(state, begin, special, end);
+}
+
+/**
+ * @brief Expands the tabs in a block of bytes and appends the result to an output buffer
+ * @details
+ * The block does not have to end at a line boundary; the output column is carried in the state
+ * and reset at every newline, so a line may be split over any number of blocks.
+ * If the configuration asks for unexpansion, runs of blanks that reach a tab stop are
+ * replaced with tabs instead, as by unexpand -a.
+ *
+ * @param state the expansion state, updated after the block
+ * @param input the bytes to expand
+ * @param length count of bytes in input
+ * @param output the output buffer to append to
+ * @return 0 on success, -1 if the output could not be written
+ */
+int expandBlock(expand_state_t *state, const char *input, size_t length, expand_output_t *output);
+
+/**
+ * @brief Ends an input: writes the blanks that an unexpansion still holds back and counts the last line
+ * @details
+ * Spaces are only written once it is known if they reach a tab stop; this has to be called
+ * after the last block of an input so that blanks at its very end are not lost.
+ *
+ * @param state the expansion state
+ * @param output the output buffer to append to
+ * @return 0 on success, -1 if the output could not be written
+ */
+int expandFinish(expand_state_t *state, expand_output_t *output);
+
+/**
+ * @brief Computes the length that a block of bytes has after expansion, without writing it
+ * @details
+ * Only for expansion, not for unexpansion.
+ *
+ * @param state the expansion state, updated after the block as by expandBlock
+ * @param input the bytes to measure
+ * @param length count of bytes in input
+ * @return count of bytes expandBlock would append for the block
+ */
+size_t expandMeasure(expand_state_t *state, const char *input, size_t length);
+
+/**
+ * @brief Processes a stream and replaces tabs with spaces, using the block engine
+ * @details
+ * The stream is read in chunks of EXPAND_CHUNK_SIZE bytes, independent of line lengths,
+ * so memory use is constant and there is no allocation per line.
+ *
+ * @param inputStream The stream to read from
+ * @param config The configuration of the expansion
+ * @param sink The sink to write the processed data to
+ * @param stats The counters of the expansion are stored here, may be NULL
+ * @return 0 on success, -1 if reading or writing failed
+ */
+int expandStream(FILE *inputStream, const expand_config_t *config, expand_sink_t sink, expand_stats_t *stats);
+
+#endif
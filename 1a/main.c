@@ -6,6 +6,7 @@
  * 
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -14,6 +15,11 @@
 #include <ctype.h>
 #include <getopt.h>
 
+#include "expand.h"
+#include "mapped.h"
+#include "parallel.h"
+#include "stats.h"
+
 /**
  * @brief Processes a stream line by line and replaces tabs with spaces
  * 
@@ -65,32 +71,87 @@ void processStreamTabs(FILE *inputStream, int tabSpaces, FILE *outputStream)
     free(line);
 }
 
+/**
+ * @brief Prints the synopsis of the program and exits with failure
+ *
+ * @param programName the name the program was called with
+ */
+static void usage(const char *programName)
+{
+    fprintf(stderr, "SYNOPSIS:\n   %s [-t tabstop[,tabstop...]] [-o outfile] [-j threads] [-u] [-U] [-r] [--stats[=file]] [file...]\n", programName);
+    exit(EXIT_FAILURE);
+}
+
 int main(int argc, char *argv[])
 {
 
     /* parsed options */
     char* outFile = NULL;
-    int tabDistance = 8;
-
-    /* get options */
+    char* tabList = NULL;
+    expand_config_t config;
+    expandConfigInit(&config);
+    bool reference = false;
+    int threads = 1;
+    bool stats = false;
+    char* statsPath = NULL;
+
+    /* get options; --stats has no short form */
+    static const struct option longOptions[] = {
+        { "stats", optional_argument, NULL, 'S' },
+        { NULL, 0, NULL, 0 }
+    };
     opterr = 0;
     int opt;
-    while ((opt = getopt(argc, argv, "t:o:")) != -1)
+    while ((opt = getopt_long(argc, argv, "t:o:j:uUr", longOptions, NULL)) != -1)
     {
         switch (opt)
         {
             case 't':
-                tabDistance = strtol(optarg, NULL, 10);
+                tabList = optarg;
                 break;
             case 'o':
                 outFile = optarg;
                 break;
+            case 'j':
+            {
+                char *end;
+                errno = 0;
+                long count = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || errno != 0 || count < 1 || count > MAX_THREADS) usage(argv[0]);
+                threads = count;
+                break;
+            }
+            case 'u':
+                config.utf8 = true;
+                break;
+            case 'U':
+                config.unexpand = true;
+                break;
+            case 'r':
+                reference = true;
+                break;
+            case 'S':
+                stats = true;
+                statsPath = optarg;
+                break;
             default:
-                fprintf(stderr, "SYNOPSIS:\n   %s [-t tabstop] [-o outfile] [file...]\n", argv[0]);
-                exit(EXIT_FAILURE);
+                usage(argv[0]);
         }
     }
 
+    /* compile the tab stops; the reference only expands, with uniform distances and byte columns, and is not counted */
+    if (tabList != NULL && expandConfigStops(&config, tabList) == -1) usage(argv[0]);
+    bool uniform = config.stopCount == 0 && config.repeatBase == 0;
+    if (threads < 1 || (reference && (config.utf8 || config.unexpand || !uniform || stats))) usage(argv[0]);
+
+    stats_report_t report;
+    if (stats && statsOpen(&report, statsPath) == -1)
+    {
+        fprintf(stderr, " - stats file %s could not be opened\n", statsPath);
+        exit(EXIT_FAILURE);
+    }
+    expand_stats_t counters;
+
     /* try to open out file */
     FILE* outputStream = stdout;
     if(outFile != NULL){
@@ -104,27 +165,52 @@ int main(int argc, char *argv[])
         }
     }
     
-    /* print parsed options */
-    printf(" - tab distance is %i spaces\n", tabDistance);
-    if (outputStream != stdout)  printf(" - out file is %s \n", outFile);
-    else printf(" - printing output to console\n");
+    /* print parsed options; status goes to stderr so that it does not mix with the output */
+    if (uniform) fprintf(stderr, " - tab distance is %i spaces\n", config.tabSpaces);
+    else fprintf(stderr, " - tab stops are %s\n", tabList);
+    if (config.utf8) fprintf(stderr, " - columns count UTF-8 display width\n");
+    if (config.unexpand) fprintf(stderr, " - replacing blanks with tabs\n");
+    if (outputStream != stdout)  fprintf(stderr, " - out file is %s \n", outFile);
+    else fprintf(stderr, " - printing output to console\n");
 
     /* check if there are positional arguments left, else read input from stdin */
     if(optind < argc){
 
+        /* with several threads, files are expanded by a pool and only written here in order */
+        expand_pool_t *pool = NULL;
+        if (threads > 1 && !reference) pool = poolStart(argv + optind, argc - optind, &config, threads);
+
+        if (pool != NULL) {
+            int index;
+            for (index = 0; optind + index < argc; index++) {
+                fprintf(stderr, " - processing file %s..\n", argv[optind + index]);
+                int result = poolWrite(pool, index, outputStream, &counters);
+
+                if (result != POOL_FILE_UNREADABLE) {
+                    if (result == POOL_FILE_FAILED) fprintf(stderr, "\n - error while processing file\n");
+                    if (stats) statsFile(&report, argv[optind + index], &counters);
+                    fprintf(stderr, "\n - finished file processing\n");
+                }
+                else fprintf(stderr, "\n - couldn't open file, skipping\n");
+            }
+            poolStop(pool);
+        }
+
         /*  remaining arguments -> filenames; perform action on each file */
-        for (; optind < argc; optind++) {
+        for (; pool == NULL && optind < argc; optind++) {
 
             /* open file */
             char* file = argv[optind];
-            printf(" - processing file %s..\n", file);
+            fprintf(stderr, " - processing file %s..\n", file);
             FILE *fileStream = fopen(file, "r");
 
             /* check if file succeeded */
             if(fileStream != NULL){
-                processStreamTabs(fileStream, tabDistance, outputStream);
+                if (reference) processStreamTabs(fileStream, config.tabSpaces, outputStream);
+                else if (expandFile(fileStream, &config, threads, outputStream, &counters) == -1) fprintf(stderr, "\n - error while processing file\n");
+                if (stats) statsFile(&report, file, &counters);
                 fclose(fileStream);
-                printf("\n - finished file processing\n");
+                fprintf(stderr, "\n - finished file processing\n");
             }
             else fprintf(stderr, "\n - couldn't open file, skipping\n");
         }
@@ -132,12 +218,16 @@ int main(int argc, char *argv[])
     else {
 
         /* no positional arguments -> read from stdin */
-        printf(" - no input file(s) specified, reading text\n");
-        processStreamTabs(stdin, tabDistance, outputStream);
-        printf("\n - finished inut processing\n");    
+        fprintf(stderr, " - no input file(s) specified, reading text\n");
+        if (reference) processStreamTabs(stdin, config.tabSpaces, outputStream);
+        else if (expandFile(stdin, &config, threads, outputStream, &counters) == -1) fprintf(stderr, "\n - error while processing input\n");
+        if (stats) statsFile(&report, "-", &counters);
+        fprintf(stderr, "\n - finished inut processing\n");    
     }
 
     /* close output stream */
     if(outputStream != stdout) fclose(outputStream);
+    if (stats && statsClose(&report) == -1) fprintf(stderr, " - stats file %s could not be written\n", statsPath);
+    expandConfigFree(&config);
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,271 @@
+/**
+ * @file mapped.c
+ * @author Tobias Scharsching (12123692)
+ * @brief Expands regular files through a memory mapping, without copying them
+ * @date 2022-11-02
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "expand.h"
+#include "mapped.h"
+#include "parallel.h"
+#include "pipeline.h"
+
+/**
+ * @brief Collects io vectors that point into the mapping or into the staging area
+ */
+typedef struct vector_output {
+    int descriptor; /** file descriptor the vectors are written to */
+    int count; /** count of collected vectors */
+    size_t staged; /** count of bytes used in the staging area */
+    expand_stats_t *stats; /** counters that the writes are added to */
+    struct iovec vectors[MAPPED_VECTOR_COUNT]; /** collected vectors */
+    char staging[MAPPED_STAGING_SIZE]; /** copies of short runs and padding */
+} vector_output_t;
+
+/**
+ * @brief Writes io vectors completely, continuing after partial writes
+ *
+ * @param descriptor the file descriptor to write to
+ * @param vectors the vectors to write; modified on partial writes
+ * @param count count of vectors
+ * @param stats counters that the writes are added to
+ * @return 0 on success, -1 if writing failed
+ */
+static int writeVectors(int descriptor, struct iovec *vectors, int count, expand_stats_t *stats)
+{
+    while (count > 0)
+    {
+        uint64_t start = expandClock();
+        ssize_t written = writev(descriptor, vectors, count);
+        stats->ioNanoseconds += expandClock() - start;
+        stats->writes++;
+        if (written == -1 && errno == EINTR) continue;
+        if (written == -1) return -1;
+        stats->bytesOut += written;
+
+        /* skip completely written vectors and shorten a partially written one */
+        while (count > 0 && (size_t)written >= vectors->iov_len)
+        {
+            written -= vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if (count > 0)
+        {
+            vectors->iov_base = (char *)vectors->iov_base + written;
+            vectors->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes all collected vectors and resets the staging area
+ *
+ * @param output the vector output
+ * @return 0 on success, -1 if writing failed
+ */
+static int flushVectors(vector_output_t *output)
+{
+    int success = writeVectors(output->descriptor, output->vectors, output->count, output->stats);
+    output->count = 0;
+    output->staged = 0;
+    return success;
+}
+
+/**
+ * @brief Adds a vector that points to bytes which stay valid until the next flush
+ *
+ * @param output the vector output
+ * @param data the bytes to reference
+ * @param length count of bytes
+ * @return 0 on success, -1 if writing failed
+ */
+static int appendBorrowed(vector_output_t *output, const char *data, size_t length)
+{
+    if (output->count == MAPPED_VECTOR_COUNT && flushVectors(output) == -1) return -1;
+
+    output->vectors[output->count].iov_base = (void *)data;
+    output->vectors[output->count].iov_len = length;
+    output->count++;
+    return 0;
+}
+
+/**
+ * @brief Copies bytes into the staging area, extending the last vector if it ends there
+ *
+ * @param output the vector output
+ * @param data the bytes to copy
+ * @param length count of bytes, at most MAPPED_STAGING_SIZE
+ * @return 0 on success, -1 if writing failed
+ */
+static int appendCopied(vector_output_t *output, const char *data, size_t length)
+{
+    if (length > MAPPED_STAGING_SIZE - output->staged && flushVectors(output) == -1) return -1;
+
+    char *target = output->staging + output->staged;
+    memcpy(target, data, length);
+    output->staged += length;
+
+    struct iovec *last = output->vectors + output->count - 1;
+    if (output->count > 0 && (char *)last->iov_base + last->iov_len == target)
+    {
+        last->iov_len += length;
+        return 0;
+    }
+    return appendBorrowed(output, target, length);
+}
+
+int expandMapped(const char *input, size_t length, const expand_config_t *config, int outputDescriptor, expand_stats_t *stats)
+{
+    uint64_t start = expandClock();
+    vector_output_t *output = malloc(sizeof(vector_output_t));
+    if (output == NULL) return -1;
+
+    expand_state_t state;
+    expandStateInit(&state, config);
+    state.stats.bytesIn = length;
+
+    output->descriptor = outputDescriptor;
+    output->count = 0;
+    output->staged = 0;
+    output->stats = &state.stats;
+
+    const char *end = input + length;
+    const char *line = input;
+    int success = 0;
+    while (success == 0 && input < end)
+    {
+        /* long runs are referenced in the mapping, short ones are copied */
+        const char *special = expandFindSpecial(input, end);
+        size_t run = special - input;
+        if (run >= MAPPED_COPY_THRESHOLD) success = appendBorrowed(output, input, run);
+        else if (run > 0) success = appendCopied(output, input, run);
+        state.column += expandRunWidth(&state, input, special, end);
+
+        if (success == -1 || special == end) break;
+
+        /* newline resets the column, tab pads up to the next stop */
+        if (*special == '\n')
+        {
+            success = appendCopied(output, "\n", 1);
+            expandCountLine(&state, special - line);
+            line = special + 1;
+            state.column = 0;
+        }
+        else
+        {
+            size_t newPosition = expandNextStop(&state, state.column);
+            size_t count = newPosition - state.column;
+            while (success == 0 && count > 0)
+            {
+                size_t spaces = count < EXPAND_SPACE_STRIP_SIZE ? count : EXPAND_SPACE_STRIP_SIZE;
+                success = appendCopied(output, EXPAND_SPACE_STRIP, spaces);
+                count -= spaces;
+            }
+            state.column = newPosition;
+            state.stats.tabs++;
+        }
+
+        input = special + 1;
+    }
+
+    if (flushVectors(output) == -1) success = -1;
+    if ((size_t)(end - line) > state.stats.longestLine) state.stats.longestLine = end - line;
+    state.stats.nanoseconds = expandClock() - start;
+    if (stats != NULL) *stats = state.stats;
+    free(output);
+    return success;
+}
+
+/**
+ * @brief Unexpands mapped bytes through the block engine and writes them to a file descriptor
+ * @details
+ * Unexpanded output is never longer than the input, so it is always collected in the
+ * output buffer instead of being referenced in the mapping.
+ *
+ * @param input the mapped bytes
+ * @param length count of bytes in input
+ * @param config the configuration of the unexpansion
+ * @param outputDescriptor the file descriptor to write to
+ * @param stats the counters of the unexpansion are stored here, may be NULL
+ * @return 0 on success, -1 if writing failed
+ */
+static int unexpandMapped(const char *input, size_t length, const expand_config_t *config, int outputDescriptor, expand_stats_t *stats)
+{
+    expand_output_t *output = malloc(sizeof(expand_output_t));
+    if (output == NULL) return -1;
+
+    expand_state_t state;
+    expandStateInit(&state, config);
+    expandOutputInit(output, expandSinkDescriptor(outputDescriptor), &state.stats);
+
+    int success = expandBlock(&state, input, length, output);
+    if (success == 0) success = expandFinish(&state, output);
+    if (success == 0) success = expandOutputFlush(output);
+    if (stats != NULL) *stats = state.stats;
+    free(output);
+    return success;
+}
+
+int expandFile(FILE *inputStream, const expand_config_t *config, int threads, FILE *outputStream, expand_stats_t *stats)
+{
+    /* data that is still buffered in the output stream has to go first */
+    if (fflush(outputStream) == EOF) return -1;
+    int inputDescriptor = fileno(inputStream);
+    int outputDescriptor = fileno(outputStream);
+    expand_stats_t counters;
+    memset(&counters, 0, sizeof(expand_stats_t));
+    uint64_t start = expandClock();
+    int success = 0;
+
+    /* only regular files with a size can be mapped, everything else goes through the pipeline */
+    struct stat info;
+    bool regular = fstat(inputDescriptor, &info) == 0 && S_ISREG(info.st_mode);
+    char *mapping = MAP_FAILED;
+    if (regular && info.st_size > 0) mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, inputDescriptor, 0);
+
+    struct stat outputInfo;
+    if (mapping != MAP_FAILED)
+    {
+        madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+
+        /*
+            huge inputs are split over threads if the output can be written at offsets;
+            pwrite ignores the offset on an O_APPEND descriptor (>>), so appends are written in order
+        */
+        if (config->unexpand) success = unexpandMapped(mapping, info.st_size, config, outputDescriptor, &counters);
+        else if (threads > 1 && info.st_size >= CHUNKED_THRESHOLD &&
+            fstat(outputDescriptor, &outputInfo) == 0 && S_ISREG(outputInfo.st_mode) &&
+            (fcntl(outputDescriptor, F_GETFL) & O_APPEND) == 0)
+        {
+            success = expandChunked(mapping, info.st_size, config, threads, outputDescriptor, &counters);
+        }
+        else success = expandMapped(mapping, info.st_size, config, outputDescriptor, &counters);
+
+        munmap(mapping, info.st_size);
+    }
+    else
+    {
+        /* files of procfs and sysfs report a size of 0 but have content, so they are read like pipes */
+        success = expandPipeline(inputDescriptor, config, outputDescriptor, &counters);
+    }
+
+    counters.nanoseconds = expandClock() - start;
+    if (stats != NULL) *stats = counters;
+    return success;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file mapped.h
+ * @author Tobias Scharsching (12123692)
+ * @brief Expands regular files through a memory mapping, without copying them
+ * @date 2022-11-02
+ *
+ */
+
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "expand.h"
+
+/**
+ * @brief The maximal count of io vectors that are collected before they are written
+ */
+#define MAPPED_VECTOR_COUNT 1024
+
+/**
+ * @brief The size of the staging area for short runs and padding, in bytes
+ */
+#define MAPPED_STAGING_SIZE (1 << 16)
+
+/**
+ * @brief Runs shorter than this are copied into the staging area instead of getting an own io vector
+ */
+#define MAPPED_COPY_THRESHOLD 256
+
+/**
+ * @brief Expands the tabs of mapped bytes and writes them to a file descriptor with writev
+ * @details
+ * Tab-free runs are written straight out of the mapped memory; only short runs and
+ * the tab padding are copied into a staging area.
+ *
+ * @param input the mapped bytes
+ * @param length count of bytes in input
+ * @param config the configuration of the expansion
+ * @param outputDescriptor the file descriptor to write to
+ * @param stats the counters of the expansion are stored here, may be NULL
+ * @return 0 on success, -1 if writing failed
+ */
+int expandMapped(const char *input, size_t length, const expand_config_t *config, int outputDescriptor, expand_stats_t *stats);
+
+/**
+ * @brief Processes a file stream and replaces tabs with spaces
+ * @details
+ * Regular files are mapped to memory and expanded with expandMapped,
+ * everything else (pipes, terminals, files that report a size of 0) is expanded with expandPipeline.
+ * With several threads, mapped files of at least CHUNKED_THRESHOLD bytes that are
+ * written to a regular file, not opened for appending, are expanded with expandChunked.
+ *
+ * @param inputStream The stream to read from
+ * @param config The configuration of the expansion
+ * @param threads The count of threads that may be used
+ * @param outputStream The stream to write the processed data to
+ * @param stats The counters of the expansion are stored here, may be NULL
+ * @return 0 on success, -1 if reading or writing failed
+ */
+int expandFile(FILE *inputStream, const expand_config_t *config, int threads, FILE *outputStream, expand_stats_t *stats);
+
+#endif
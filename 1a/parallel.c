@@ -0,0 +1,502 @@
+/**
+ * @file parallel.c
+ * @author Tobias Scharsching (12123692)
+ * @brief A worker pool that expands several files concurrently and hands them out in order
+ * @date 2022-11-02
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "expand.h"
+#include "mapped.h"
+#include "parallel.h"
+
+/* ----------       chunk parallel expansion of one file       ---------- */
+
+/**
+ * @brief A line aligned part of the input of expandChunked
+ */
+typedef struct chunk {
+    const char *input; /** first byte of the chunk */
+    size_t length; /** count of bytes in the chunk */
+    off_t offset; /** output offset of the expanded chunk */
+    size_t size; /** expanded size of the chunk */
+} chunk_t;
+
+/**
+ * @brief The work of one thread of expandChunked
+ */
+typedef struct chunk_worker {
+    chunk_t *chunks; /** all chunks */
+    int count; /** count of chunks */
+    int first; /** index of the first chunk of this worker */
+    int step; /** distance between the chunks of this worker */
+    const expand_config_t *config; /** the configuration of the expansion */
+    int descriptor; /** output file descriptor */
+    int success; /** result of the worker */
+    expand_stats_t stats; /** counters of the chunks of this worker */
+} chunk_worker_t;
+
+/**
+ * @brief Target of an output buffer that writes to a file at increasing offsets
+ */
+typedef struct offset_target {
+    int descriptor; /** file descriptor to write to */
+    off_t offset; /** offset of the next write */
+} offset_target_t;
+
+/**
+ * @brief Write function of output buffers that write with pwrite
+ *
+ * @param target the offset target
+ * @param data the bytes to write
+ * @param length count of bytes to write
+ * @return 0 on success, -1 if writing failed
+ */
+static int writeAtOffset(void *target, const char *data, size_t length)
+{
+    offset_target_t *file = target;
+    while (length > 0)
+    {
+        ssize_t written = pwrite(file->descriptor, data, length, file->offset);
+        if (written == -1 && errno == EINTR) continue;
+        if (written == -1) return -1;
+
+        data += written;
+        length -= written;
+        file->offset += written;
+    }
+    return 0;
+}
+
+/**
+ * @brief First pass: computes the expanded size of the chunks of a worker
+ *
+ * @param argument the chunk worker
+ * @return NULL
+ */
+static void *measureChunks(void *argument)
+{
+    chunk_worker_t *worker = argument;
+
+    int i;
+    for (i = worker->first; i < worker->count; i += worker->step)
+    {
+        expand_state_t state;
+        expandStateInit(&state, worker->config);
+        worker->chunks[i].size = expandMeasure(&state, worker->chunks[i].input, worker->chunks[i].length);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Second pass: expands the chunks of a worker and writes them at their offsets
+ *
+ * @param argument the chunk worker
+ * @return NULL
+ */
+static void *writeChunks(void *argument)
+{
+    chunk_worker_t *worker = argument;
+    expand_output_t *output = malloc(sizeof(expand_output_t));
+    worker->success = output == NULL ? -1 : 0;
+
+    int i;
+    for (i = worker->first; worker->success == 0 && i < worker->count; i += worker->step)
+    {
+        offset_target_t target = { worker->descriptor, worker->chunks[i].offset };
+        expand_state_t state;
+        expand_sink_t sink = { writeAtOffset, &target };
+        expandStateInit(&state, worker->config);
+        expandOutputInit(output, sink, &worker->stats);
+
+        if (expandBlock(&state, worker->chunks[i].input, worker->chunks[i].length, output) == -1 ||
+            expandFinish(&state, output) == -1 || expandOutputFlush(output) == -1) worker->success = -1;
+        expandStatsAdd(&worker->stats, &state.stats);
+    }
+
+    free(output);
+    return NULL;
+}
+
+/**
+ * @brief Runs a function on one thread per worker and waits for all of them
+ * @details
+ * If a thread can't be created, its work is done on the calling thread.
+ *
+ * @param workers the workers
+ * @param count count of workers
+ * @param function the function to run for each worker
+ */
+static void runWorkers(chunk_worker_t *workers, int count, void *(*function)(void *))
+{
+    pthread_t threads[count];
+    bool started[count];
+
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        started[i] = pthread_create(threads + i, NULL, function, workers + i) == 0;
+        if (!started[i]) function(workers + i);
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+}
+
+int expandChunked(const char *input, size_t length, const expand_config_t *config, int threads, int outputDescriptor, expand_stats_t *stats)
+{
+    uint64_t start = expandClock();
+    if (threads > MAX_THREADS) threads = MAX_THREADS;    // bounds the thread arrays of runWorkers on the stack
+    int count = threads * CHUNKS_PER_THREAD;
+    chunk_t *chunks = malloc(count * sizeof(chunk_t));
+    chunk_worker_t *workers = malloc(threads * sizeof(chunk_worker_t));
+    if (chunks == NULL || workers == NULL)
+    {
+        free(chunks);
+        free(workers);
+        return -1;
+    }
+
+    /*
+        split at the first newline after every nth part of the input,
+        chunks that would be empty because of long lines are dropped
+    */
+    const char *end = input + length;
+    const char *begin = input;
+    int chunkCount = 0;
+    int i;
+    for (i = 1; i <= count && begin < end; i++)
+    {
+        const char *split = end;
+        if (i < count)
+        {
+            const char *target = input + length / count * i;
+            if (target < begin) continue;
+            split = memchr(target, '\n', end - target);
+            split = split == NULL ? end : split + 1;
+        }
+
+        chunks[chunkCount].input = begin;
+        chunks[chunkCount].length = split - begin;
+        chunkCount++;
+        begin = split;
+    }
+
+    for (i = 0; i < threads; i++)
+    {
+        workers[i].chunks = chunks;
+        workers[i].count = chunkCount;
+        workers[i].first = i;
+        workers[i].step = threads;
+        workers[i].config = config;
+        workers[i].descriptor = outputDescriptor;
+        workers[i].success = 0;
+        memset(&workers[i].stats, 0, sizeof(expand_stats_t));
+    }
+
+    /* first pass: sizes, then offsets behind the current file offset */
+    runWorkers(workers, threads, measureChunks);
+
+    off_t offset = lseek(outputDescriptor, 0, SEEK_CUR);
+    int success = offset == -1 ? -1 : 0;
+    for (i = 0; i < chunkCount; i++)
+    {
+        chunks[i].offset = offset;
+        offset += chunks[i].size;
+    }
+
+    /* pre-size the file, then second pass: expand and write at the offsets */
+    if (success == 0 && ftruncate(outputDescriptor, offset) == -1) success = -1;
+    if (success == 0)
+    {
+        runWorkers(workers, threads, writeChunks);
+        for (i = 0; i < threads; i++)
+        {
+            if (workers[i].success == -1) success = -1;
+        }
+    }
+    if (success == 0 && lseek(outputDescriptor, offset, SEEK_SET) == -1) success = -1;
+
+    if (stats != NULL)
+    {
+        memset(stats, 0, sizeof(expand_stats_t));
+        for (i = 0; i < threads; i++) expandStatsAdd(stats, &workers[i].stats);
+        stats->nanoseconds = expandClock() - start;
+    }
+
+    free(workers);
+    free(chunks);
+    return success;
+}
+
+/* ----------       pool for expansion of several files       ---------- */
+
+/**
+ * @brief State of a job that is not claimed by a worker yet
+ */
+#define JOB_PENDING 0
+
+/**
+ * @brief State of a job that a worker is expanding
+ */
+#define JOB_RUNNING 1
+
+/**
+ * @brief State of a job whose result is ready to be written
+ */
+#define JOB_DONE 2
+
+/**
+ * @brief A file of the pool and the result of its expansion
+ */
+typedef struct pool_job {
+    const char *file; /** path of the file */
+    int state; /** JOB_PENDING, JOB_RUNNING or JOB_DONE */
+    int result; /** POOL_FILE_* result of the expansion */
+    expand_memory_t memory; /** expanded file held in memory */
+    FILE *spill; /** temporary file that holds the expanded file, or NULL */
+    bool direct; /** indicates that the file is too big for a worker and has to be expanded by the writer */
+    expand_stats_t stats; /** counters of the expansion */
+} pool_job_t;
+
+struct expand_pool {
+    pthread_mutex_t lock; /** protects all fields below */
+    pthread_cond_t changed; /** signaled when a job is done or written, or the pool stops */
+    pool_job_t *jobs; /** one job per file */
+    int count; /** count of jobs */
+    int next; /** index of the next job to claim */
+    int written; /** count of jobs that were written */
+    int window; /** how many jobs workers may be ahead of the writer */
+    const expand_config_t *config; /** the configuration of the expansion */
+    int chunkThreads; /** count of threads huge files are expanded with */
+    bool stopping; /** indicates that workers have to terminate */
+    int threadCount; /** count of started threads */
+    pthread_t *threads; /** the worker threads */
+};
+
+/**
+ * @brief Expands the file of a job into memory or a spill file
+ *
+ * @param job the job to process
+ * @param config the configuration of the expansion
+ */
+static void processJob(pool_job_t *job, const expand_config_t *config)
+{
+    FILE *inputStream = fopen(job->file, "r");
+    if (inputStream == NULL)
+    {
+        job->result = POOL_FILE_UNREADABLE;
+        return;
+    }
+
+    /* huge files are left to the writer, big files go to a temporary file so that memory stays bounded */
+    struct stat info;
+    bool regular = fstat(fileno(inputStream), &info) == 0 && S_ISREG(info.st_mode);
+    if (regular && info.st_size >= CHUNKED_THRESHOLD)
+    {
+        fclose(inputStream);
+        job->direct = true;
+        job->result = POOL_FILE_OK;
+        return;
+    }
+    if (regular && info.st_size > POOL_SPILL_THRESHOLD && (job->spill = tmpfile()) == NULL)
+    {
+        fclose(inputStream);
+        job->result = POOL_FILE_FAILED;
+        return;
+    }
+
+    expand_sink_t sink = job->spill != NULL ? expandSinkStream(job->spill) : expandSinkMemory(&job->memory);
+    job->result = expandStream(inputStream, config, sink, &job->stats) == -1 ? POOL_FILE_FAILED : POOL_FILE_OK;
+    fclose(inputStream);
+}
+
+/**
+ * @brief Worker thread that claims and processes jobs until all are claimed or the pool stops
+ *
+ * @param argument the pool
+ * @return NULL
+ */
+static void *work(void *argument)
+{
+    expand_pool_t *pool = argument;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true)
+    {
+        /* wait until the next job is within the window of the writer */
+        while (!pool->stopping && pool->next < pool->count && pool->next >= pool->written + pool->window)
+        {
+            pthread_cond_wait(&pool->changed, &pool->lock);
+        }
+        if (pool->stopping || pool->next >= pool->count) break;
+
+        pool_job_t *job = pool->jobs + pool->next++;
+        job->state = JOB_RUNNING;
+        pthread_mutex_unlock(&pool->lock);
+
+        processJob(job, pool->config);
+
+        pthread_mutex_lock(&pool->lock);
+        job->state = JOB_DONE;
+        pthread_cond_broadcast(&pool->changed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+expand_pool_t *poolStart(char **files, int count, const expand_config_t *config, int threads)
+{
+    /* huge files are chunked with all threads; more workers than files would only wait */
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    int chunkThreads = threads;
+    if (threads > count) threads = count > 0 ? count : 1;
+
+    expand_pool_t *pool = malloc(sizeof(expand_pool_t));
+    if (pool == NULL) return NULL;
+
+    pool->jobs = calloc(count, sizeof(pool_job_t));
+    pool->threads = malloc(threads * sizeof(pthread_t));
+    if (pool->jobs == NULL || pool->threads == NULL)
+    {
+        free(pool->jobs);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        pool->jobs[i].file = files[i];
+        pool->jobs[i].state = JOB_PENDING;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->changed, NULL);
+    pool->count = count;
+    pool->next = 0;
+    pool->written = 0;
+    pool->window = 2 * threads;
+    pool->config = config;
+    pool->chunkThreads = chunkThreads;
+    pool->stopping = false;
+
+    /* start workers; a pool with at least one worker is usable */
+    for (pool->threadCount = 0; pool->threadCount < threads; pool->threadCount++)
+    {
+        if (pthread_create(pool->threads + pool->threadCount, NULL, work, pool) != 0) break;
+    }
+    if (pool->threadCount == 0)
+    {
+        poolStop(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+/**
+ * @brief Copies a spill file to a stream
+ *
+ * @param spill the spill file
+ * @param outputStream the stream to copy to
+ * @return 0 on success, -1 if reading or writing failed
+ */
+static int copySpill(FILE *spill, FILE *outputStream)
+{
+    char *chunk = malloc(EXPAND_CHUNK_SIZE);
+    if (chunk == NULL) return -1;
+
+    rewind(spill);
+    size_t length;
+    int success = 0;
+    while (success == 0 && (length = fread(chunk, 1, EXPAND_CHUNK_SIZE, spill)) > 0)
+    {
+        if (fwrite(chunk, 1, length, outputStream) != length) success = -1;
+    }
+    if (ferror(spill)) success = -1;
+
+    free(chunk);
+    return success;
+}
+
+int poolWrite(expand_pool_t *pool, int index, FILE *outputStream, expand_stats_t *stats)
+{
+    pool_job_t *job = pool->jobs + index;
+
+    pthread_mutex_lock(&pool->lock);
+    while (job->state != JOB_DONE) pthread_cond_wait(&pool->changed, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    /* write result and release it; huge files are expanded here with all threads */
+    int result = job->result;
+    if (job->direct)
+    {
+        FILE *inputStream = fopen(job->file, "r");
+        if (inputStream == NULL) result = POOL_FILE_UNREADABLE;
+        else
+        {
+            if (expandFile(inputStream, pool->config, pool->chunkThreads, outputStream, &job->stats) == -1) result = POOL_FILE_FAILED;
+            fclose(inputStream);
+        }
+    }
+
+    /* copying the result counts as output time */
+    uint64_t start = expandClock();
+    if (job->memory.length > 0 && fwrite(job->memory.data, 1, job->memory.length, outputStream) != job->memory.length) result = POOL_FILE_FAILED;
+    if (job->spill != NULL && copySpill(job->spill, outputStream) == -1) result = POOL_FILE_FAILED;
+    uint64_t copied = expandClock() - start;
+    job->stats.ioNanoseconds += copied;
+    job->stats.nanoseconds += copied;
+    if (stats != NULL) *stats = job->stats;
+
+    free(job->memory.data);
+    job->memory.data = NULL;
+    job->memory.length = 0;
+    if (job->spill != NULL) fclose(job->spill);
+    job->spill = NULL;
+
+    /* let workers claim further jobs */
+    pthread_mutex_lock(&pool->lock);
+    pool->written = index + 1;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+
+    return result;
+}
+
+void poolStop(expand_pool_t *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+
+    int i;
+    for (i = 0; i < pool->threadCount; i++) pthread_join(pool->threads[i], NULL);
+
+    for (i = 0; i < pool->count; i++)
+    {
+        free(pool->jobs[i].memory.data);
+        if (pool->jobs[i].spill != NULL) fclose(pool->jobs[i].spill);
+    }
+
+    pthread_cond_destroy(&pool->changed);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool->jobs);
+    free(pool);
+}
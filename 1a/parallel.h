@@ -0,0 +1,114 @@
+/**
+ * @file parallel.h
+ * @author Tobias Scharsching (12123692)
+ * @brief A worker pool that expands several files concurrently and hands them out in order
+ * @date 2022-11-02
+ *
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdio.h>
+
+#include "expand.h"
+
+/**
+ * @brief Files bigger than this are expanded into a temporary file instead of memory, in bytes
+ */
+#define POOL_SPILL_THRESHOLD (32L << 20)
+
+/**
+ * @brief Mapped files of at least this size are split into line aligned chunks that are expanded concurrently, in bytes
+ * @details
+ * may be defined when building, make check lowers it so that small files take the chunked path
+ */
+#ifndef CHUNKED_THRESHOLD
+#define CHUNKED_THRESHOLD (64L << 20)
+#endif
+
+/**
+ * @brief The largest count of threads that is used, larger counts are clamped to it
+ */
+#define MAX_THREADS 1024
+
+/**
+ * @brief Count of chunks a file is split into per thread, so that uneven chunks even out
+ */
+#define CHUNKS_PER_THREAD 4
+
+/**
+ * @brief Result of a file that was expanded and written successfully
+ */
+#define POOL_FILE_OK 0
+
+/**
+ * @brief Result of a file that could not be expanded or written completely
+ */
+#define POOL_FILE_FAILED -1
+
+/**
+ * @brief Result of a file that could not be opened
+ */
+#define POOL_FILE_UNREADABLE -2
+
+/**
+ * @brief Expands mapped bytes on several threads and writes them to a regular file at precomputed offsets
+ * @details
+ * The input is split into chunks that start at line boundaries, so every chunk starts at column 0.
+ * A first pass computes the expanded size of every chunk, the output file is resized to hold all
+ * of them behind its current offset, and a second pass expands the chunks and writes them with pwrite.
+ * Afterwards the file offset is moved behind the written data.
+ *
+ * @param input the mapped bytes
+ * @param length count of bytes in input
+ * @param config the configuration of the expansion
+ * @param threads count of threads to use, at most MAX_THREADS are used
+ * @param outputDescriptor file descriptor of a regular file
+ * @param stats the counters of all chunks are stored here, may be NULL
+ * @return 0 on success, -1 if writing failed
+ */
+int expandChunked(const char *input, size_t length, const expand_config_t *config, int threads, int outputDescriptor, expand_stats_t *stats);
+
+/**
+ * @brief A pool of worker threads that expand a list of files
+ */
+typedef struct expand_pool expand_pool_t;
+
+/**
+ * @brief Starts worker threads that expand the given files
+ * @details
+ * Workers claim files in order but stay at most a window of files ahead of the
+ * last file that was written, so memory and spill space stay bounded.
+ * Files of at least CHUNKED_THRESHOLD bytes are left to the writer, which expands
+ * them with all threads through expandFile.
+ *
+ * @param files the paths of the files to expand
+ * @param count count of files
+ * @param config the configuration of the expansion, has to live as long as the pool
+ * @param threads count of worker threads, clamped to MAX_THREADS and to the count of files
+ * @return the started pool, NULL if it could not be started
+ */
+expand_pool_t *poolStart(char **files, int count, const expand_config_t *config, int threads);
+
+/**
+ * @brief Waits until a file is expanded and writes its result to a stream
+ * @details
+ * Files have to be written in the order they were passed to poolStart.
+ *
+ * @param pool the pool
+ * @param index the index of the file
+ * @param outputStream the stream to write the expanded file to
+ * @param stats the counters of the expansion of the file are stored here, may be NULL
+ * @return POOL_FILE_OK, POOL_FILE_FAILED or POOL_FILE_UNREADABLE
+ */
+int poolWrite(expand_pool_t *pool, int index, FILE *outputStream, expand_stats_t *stats);
+
+/**
+ * @brief Stops all workers and frees the pool including results that were not written
+ *
+ * @param pool the pool
+ */
+void poolStop(expand_pool_t *pool);
+
+#endif
@@ -0,0 +1,689 @@
+/**
+ * @file pipeline.c
+ * @author Tobias Scharsching (12123692)
+ * @brief Expands pipes and terminals with reading, expanding and writing overlapped
+ * @date 2022-11-02
+ *
+ * At most one read and one write are in flight at any time, so reads and writes
+ * keep the order of the stream; the overlap comes from expanding one input
+ * chunk while the next is read and the previous output buffer is written.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+#include "expand.h"
+#include "pipeline.h"
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#define PIPELINE_URING 1
+#else
+#define PIPELINE_URING 0
+#endif
+
+/**
+ * @brief Tag of the read transfer
+ */
+#define TRANSFER_READ 1
+
+/**
+ * @brief Tag of the write transfer
+ */
+#define TRANSFER_WRITE 2
+
+/**
+ * @brief Performs a transfer synchronously; reads once, writes completely
+ *
+ * @param kind TRANSFER_READ or TRANSFER_WRITE
+ * @param descriptor the file descriptor
+ * @param buffer the buffer to read into or write from
+ * @param length count of bytes
+ * @return count of bytes read or written, -1 on error
+ */
+static ssize_t transfer(int kind, int descriptor, char *buffer, size_t length)
+{
+    if (kind == TRANSFER_READ)
+    {
+        ssize_t result;
+        while ((result = read(descriptor, buffer, length)) == -1 && errno == EINTR);
+        return result;
+    }
+
+    size_t done = 0;
+    while (done < length)
+    {
+        ssize_t written = write(descriptor, buffer + done, length - done);
+        if (written == -1 && errno == EINTR) continue;
+        if (written == -1) return -1;
+        done += written;
+    }
+    return done;
+}
+
+/* ----------       io_uring backend       ---------- */
+
+#if PIPELINE_URING
+
+/**
+ * @brief A mapped io_uring instance
+ */
+typedef struct uring {
+    int descriptor; /** file descriptor of the ring */
+    unsigned *submitTail; /** tail of the submission queue */
+    unsigned *submitMask; /** index mask of the submission queue */
+    unsigned *submitArray; /** indexes of the submitted entries */
+    unsigned *completeHead; /** head of the completion queue */
+    unsigned *completeTail; /** tail of the completion queue */
+    unsigned *completeMask; /** index mask of the completion queue */
+    struct io_uring_sqe *entries; /** submission queue entries */
+    struct io_uring_cqe *completions; /** completion queue entries */
+    void *submitRing; /** mapping of the submission queue */
+    size_t submitRingSize; /** size of the submission queue mapping */
+    void *completeRing; /** mapping of the completion queue, may equal submitRing */
+    size_t completeRingSize; /** size of the completion queue mapping */
+    size_t entriesSize; /** size of the entries mapping */
+} uring_t;
+
+/**
+ * @brief Sets up an io_uring instance and maps its queues
+ *
+ * @param ring the ring to set up
+ * @return 0 on success, -1 if io_uring is not available or lacks features
+ */
+static int uringOpen(uring_t *ring)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->descriptor = syscall(__NR_io_uring_setup, PIPELINE_QUEUE_DEPTH, &params);
+    if (ring->descriptor == -1) return -1;
+
+    /* transfers have to use and advance the file position like read and write do */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+    {
+        close(ring->descriptor);
+        return -1;
+    }
+
+    ring->submitRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->completeRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->entriesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    /* newer kernels map both queues with one mapping */
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && ring->completeRingSize > ring->submitRingSize) ring->submitRingSize = ring->completeRingSize;
+
+    ring->submitRing = mmap(NULL, ring->submitRingSize, PROT_READ | PROT_WRITE, MAP_SHARED, ring->descriptor, IORING_OFF_SQ_RING);
+    ring->completeRing = single ? ring->submitRing :
+        mmap(NULL, ring->completeRingSize, PROT_READ | PROT_WRITE, MAP_SHARED, ring->descriptor, IORING_OFF_CQ_RING);
+    ring->entries = mmap(NULL, ring->entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED, ring->descriptor, IORING_OFF_SQES);
+
+    if (ring->submitRing == MAP_FAILED || ring->completeRing == MAP_FAILED || ring->entries == MAP_FAILED)
+    {
+        if (ring->entries != MAP_FAILED) munmap(ring->entries, ring->entriesSize);
+        if (!single && ring->completeRing != MAP_FAILED) munmap(ring->completeRing, ring->completeRingSize);
+        if (ring->submitRing != MAP_FAILED) munmap(ring->submitRing, ring->submitRingSize);
+        close(ring->descriptor);
+        return -1;
+    }
+    if (single) ring->completeRingSize = 0;
+
+    char *submit = ring->submitRing;
+    char *complete = ring->completeRing;
+    ring->submitTail = (unsigned *)(submit + params.sq_off.tail);
+    ring->submitMask = (unsigned *)(submit + params.sq_off.ring_mask);
+    ring->submitArray = (unsigned *)(submit + params.sq_off.array);
+    ring->completeHead = (unsigned *)(complete + params.cq_off.head);
+    ring->completeTail = (unsigned *)(complete + params.cq_off.tail);
+    ring->completeMask = (unsigned *)(complete + params.cq_off.ring_mask);
+    ring->completions = (struct io_uring_cqe *)(complete + params.cq_off.cqes);
+    return 0;
+}
+
+/**
+ * @brief Unmaps and closes an io_uring instance
+ *
+ * @param ring the ring
+ */
+static void uringClose(uring_t *ring)
+{
+    munmap(ring->entries, ring->entriesSize);
+    if (ring->completeRingSize > 0) munmap(ring->completeRing, ring->completeRingSize);
+    munmap(ring->submitRing, ring->submitRingSize);
+    close(ring->descriptor);
+}
+
+/**
+ * @brief Submits a read or write at the current file position
+ *
+ * @param ring the ring
+ * @param kind TRANSFER_READ or TRANSFER_WRITE, also used as tag of the completion
+ * @param descriptor the file descriptor
+ * @param buffer the buffer to read into or write from
+ * @param length count of bytes
+ * @return 0 on success, -1 if the submission failed
+ */
+static int uringSubmit(uring_t *ring, int kind, int descriptor, char *buffer, size_t length)
+{
+    unsigned tail = *ring->submitTail;
+    unsigned index = tail & *ring->submitMask;
+    struct io_uring_sqe *entry = ring->entries + index;
+
+    memset(entry, 0, sizeof(*entry));
+    entry->opcode = kind == TRANSFER_READ ? IORING_OP_READ : IORING_OP_WRITE;
+    entry->fd = descriptor;
+    entry->addr = (uintptr_t)buffer;
+    entry->len = length;
+    entry->off = (uint64_t)-1;
+    entry->user_data = kind;
+
+    ring->submitArray[index] = index;
+    __atomic_store_n(ring->submitTail, tail + 1, __ATOMIC_RELEASE);
+
+    while (syscall(__NR_io_uring_enter, ring->descriptor, 1, 0, 0, NULL, 0) == -1)
+    {
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Takes the next completion, waiting for one if there is none
+ *
+ * @param ring the ring
+ * @param kind the tag of the completed transfer
+ * @param result the result of the transfer, a negative error number on failure
+ * @return 0 on success, -1 if waiting failed
+ */
+static int uringReap(uring_t *ring, int *kind, ssize_t *result)
+{
+    while (true)
+    {
+        unsigned head = *ring->completeHead;
+        if (head != __atomic_load_n(ring->completeTail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe *completion = ring->completions + (head & *ring->completeMask);
+            *kind = completion->user_data;
+            *result = completion->res;
+            __atomic_store_n(ring->completeHead, head + 1, __ATOMIC_RELEASE);
+            return 0;
+        }
+
+        if (syscall(__NR_io_uring_enter, ring->descriptor, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) == -1 && errno != EINTR)
+        {
+            return -1;
+        }
+    }
+}
+
+#endif
+
+/* ----------       thread backend       ---------- */
+
+/**
+ * @brief State of a channel without a transfer
+ */
+#define CHANNEL_IDLE 0
+
+/**
+ * @brief State of a channel whose transfer waits for the thread
+ */
+#define CHANNEL_REQUESTED 1
+
+/**
+ * @brief State of a channel whose transfer is done
+ */
+#define CHANNEL_COMPLETE 2
+
+/**
+ * @brief A thread that performs the transfers of one direction
+ * @details
+ * If the thread can't be started, transfers are performed synchronously when they are finished.
+ */
+typedef struct channel {
+    pthread_mutex_t lock; /** protects state, result and error */
+    pthread_cond_t changed; /** signaled on state changes */
+    pthread_t thread; /** the transfer thread */
+    bool threaded; /** indicates that the thread is running */
+    bool stopping; /** indicates that the thread has to terminate */
+    int kind; /** TRANSFER_READ or TRANSFER_WRITE */
+    int descriptor; /** file descriptor to transfer on */
+    char *buffer; /** buffer of the current transfer */
+    size_t length; /** length of the current transfer */
+    int state; /** CHANNEL_IDLE, CHANNEL_REQUESTED or CHANNEL_COMPLETE */
+    ssize_t result; /** result of the last transfer */
+    int error; /** errno of the last transfer */
+} channel_t;
+
+/**
+ * @brief Thread function of a channel that performs requested transfers until stopped
+ *
+ * @param argument the channel
+ * @return NULL
+ */
+static void *runChannel(void *argument)
+{
+    channel_t *channel = argument;
+
+    pthread_mutex_lock(&channel->lock);
+    while (true)
+    {
+        while (channel->state != CHANNEL_REQUESTED && !channel->stopping) pthread_cond_wait(&channel->changed, &channel->lock);
+        if (channel->state != CHANNEL_REQUESTED) break;
+        pthread_mutex_unlock(&channel->lock);
+
+        ssize_t result = transfer(channel->kind, channel->descriptor, channel->buffer, channel->length);
+        int error = errno;
+
+        pthread_mutex_lock(&channel->lock);
+        channel->result = result;
+        channel->error = error;
+        channel->state = CHANNEL_COMPLETE;
+        pthread_cond_broadcast(&channel->changed);
+    }
+    pthread_mutex_unlock(&channel->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Initializes a channel and starts its thread
+ *
+ * @param channel the channel
+ * @param kind TRANSFER_READ or TRANSFER_WRITE
+ * @param descriptor the file descriptor to transfer on
+ */
+static void channelOpen(channel_t *channel, int kind, int descriptor)
+{
+    pthread_mutex_init(&channel->lock, NULL);
+    pthread_cond_init(&channel->changed, NULL);
+    channel->kind = kind;
+    channel->descriptor = descriptor;
+    channel->state = CHANNEL_IDLE;
+    channel->stopping = false;
+    channel->threaded = pthread_create(&channel->thread, NULL, runChannel, channel) == 0;
+}
+
+/**
+ * @brief Requests a transfer on a channel
+ *
+ * @param channel the channel, without a pending transfer
+ * @param buffer the buffer to read into or write from
+ * @param length count of bytes
+ */
+static void channelStart(channel_t *channel, char *buffer, size_t length)
+{
+    pthread_mutex_lock(&channel->lock);
+    channel->buffer = buffer;
+    channel->length = length;
+    channel->state = CHANNEL_REQUESTED;
+    pthread_cond_broadcast(&channel->changed);
+    pthread_mutex_unlock(&channel->lock);
+}
+
+/**
+ * @brief Waits for the requested transfer of a channel
+ *
+ * @param channel the channel
+ * @return the result of the transfer, -1 with errno set on failure
+ */
+static ssize_t channelFinish(channel_t *channel)
+{
+    if (!channel->threaded)
+    {
+        channel->state = CHANNEL_IDLE;
+        return transfer(channel->kind, channel->descriptor, channel->buffer, channel->length);
+    }
+
+    pthread_mutex_lock(&channel->lock);
+    while (channel->state != CHANNEL_COMPLETE) pthread_cond_wait(&channel->changed, &channel->lock);
+    channel->state = CHANNEL_IDLE;
+    ssize_t result = channel->result;
+    errno = channel->error;
+    pthread_mutex_unlock(&channel->lock);
+
+    return result;
+}
+
+/**
+ * @brief Stops the thread of a channel and releases it
+ *
+ * @param channel the channel, without a pending transfer
+ */
+static void channelClose(channel_t *channel)
+{
+    if (channel->threaded)
+    {
+        pthread_mutex_lock(&channel->lock);
+        channel->stopping = true;
+        pthread_cond_broadcast(&channel->changed);
+        pthread_mutex_unlock(&channel->lock);
+        pthread_join(channel->thread, NULL);
+    }
+    pthread_cond_destroy(&channel->changed);
+    pthread_mutex_destroy(&channel->lock);
+}
+
+/* ----------       pipeline       ---------- */
+
+/**
+ * @brief State of one pipelined expansion
+ */
+typedef struct pipeline {
+    bool uring; /** indicates that transfers run on the ring, else on the channels */
+#if PIPELINE_URING
+    uring_t ring; /** the io_uring instance */
+#endif
+    channel_t reader; /** channel for reads */
+    channel_t writer; /** channel for writes */
+    int inputDescriptor; /** file descriptor to read from */
+    int outputDescriptor; /** file descriptor to write to */
+    bool reading; /** a read is in flight */
+    bool readComplete; /** the read in flight has a completion */
+    ssize_t readResult; /** result of the completed read */
+    bool writing; /** a write is in flight */
+    bool writeComplete; /** the write in flight has a completion */
+    ssize_t writeResult; /** result of the completed write */
+    const char *writeData; /** remaining data of the write in flight */
+    size_t writeLength; /** remaining length of the write in flight */
+    expand_output_t *output; /** output buffer the expansion appends to */
+    char *spare; /** the output buffer that is not being filled */
+    expand_stats_t *stats; /** counters that the transfers are added to */
+} pipeline_t;
+
+#if PIPELINE_URING
+/**
+ * @brief Takes completions until a transfer is complete
+ *
+ * @param pipeline the pipeline
+ * @param complete the completion flag of the transfer
+ * @return 0 on success, -1 if waiting failed
+ */
+static int reapUntil(pipeline_t *pipeline, bool *complete)
+{
+    while (!*complete)
+    {
+        int kind;
+        ssize_t result;
+        if (uringReap(&pipeline->ring, &kind, &result) == -1) return -1;
+
+        if (kind == TRANSFER_READ)
+        {
+            pipeline->readComplete = true;
+            pipeline->readResult = result;
+        }
+        else
+        {
+            pipeline->writeComplete = true;
+            pipeline->writeResult = result;
+        }
+    }
+    return 0;
+}
+#endif
+
+/**
+ * @brief Starts reading the next chunk of the input
+ *
+ * @param pipeline the pipeline, without a read in flight
+ * @param buffer the buffer to read into, EXPAND_CHUNK_SIZE bytes
+ * @return 0 on success, -1 if the read could not be started
+ */
+static int startRead(pipeline_t *pipeline, char *buffer)
+{
+    pipeline->reading = true;
+    pipeline->readComplete = false;
+    pipeline->stats->reads++;
+#if PIPELINE_URING
+    if (pipeline->uring && uringSubmit(&pipeline->ring, TRANSFER_READ, pipeline->inputDescriptor, buffer, EXPAND_CHUNK_SIZE) == -1)
+    {
+        pipeline->reading = false;
+        return -1;
+    }
+    if (pipeline->uring) return 0;
+#endif
+    channelStart(&pipeline->reader, buffer, EXPAND_CHUNK_SIZE);
+    return 0;
+}
+
+/**
+ * @brief Waits for the read in flight
+ *
+ * @param pipeline the pipeline
+ * @return count of bytes read, 0 at end of input or if no read is in flight, -1 on error
+ */
+static ssize_t finishRead(pipeline_t *pipeline)
+{
+    if (!pipeline->reading) return 0;
+    pipeline->reading = false;
+    uint64_t start = expandClock();
+    ssize_t result;
+
+#if PIPELINE_URING
+    if (pipeline->uring)
+    {
+        if (reapUntil(pipeline, &pipeline->readComplete) == -1) result = -1;
+        else if (pipeline->readResult >= 0) result = pipeline->readResult;
+        else
+        {
+            errno = -pipeline->readResult;
+            result = -1;
+        }
+    }
+    else
+#endif
+    result = channelFinish(&pipeline->reader);
+
+    pipeline->stats->ioNanoseconds += expandClock() - start;
+    return result;
+}
+
+/**
+ * @brief Starts writing data to the output
+ *
+ * @param pipeline the pipeline, without a write in flight
+ * @param data the data, has to stay unchanged until the write is finished
+ * @param length count of bytes
+ * @return 0 on success, -1 if the write could not be started
+ */
+static int startWrite(pipeline_t *pipeline, const char *data, size_t length)
+{
+    pipeline->writing = true;
+    pipeline->writeComplete = false;
+    pipeline->writeData = data;
+    pipeline->writeLength = length;
+    pipeline->stats->writes++;
+    pipeline->stats->bytesOut += length;
+#if PIPELINE_URING
+    if (pipeline->uring && uringSubmit(&pipeline->ring, TRANSFER_WRITE, pipeline->outputDescriptor, (char *)data, length) == -1)
+    {
+        pipeline->writing = false;
+        return -1;
+    }
+    if (pipeline->uring) return 0;
+#endif
+    channelStart(&pipeline->writer, (char *)data, length);
+    return 0;
+}
+
+/**
+ * @brief Waits until the write in flight is written completely
+ *
+ * @param pipeline the pipeline
+ * @return 0 on success or if no write is in flight, -1 on error
+ */
+static int finishWrite(pipeline_t *pipeline)
+{
+    if (!pipeline->writing) return 0;
+    pipeline->writing = false;
+    uint64_t start = expandClock();
+    int success = 0;
+
+#if PIPELINE_URING
+    if (pipeline->uring)
+    {
+        /* the ring may write partially, the rest is submitted again */
+        while (true)
+        {
+            if (reapUntil(pipeline, &pipeline->writeComplete) == -1)
+            {
+                success = -1;
+                break;
+            }
+            if (pipeline->writeResult <= 0)
+            {
+                errno = pipeline->writeResult == 0 ? EIO : -pipeline->writeResult;
+                success = -1;
+                break;
+            }
+
+            pipeline->writeData += pipeline->writeResult;
+            pipeline->writeLength -= pipeline->writeResult;
+            if (pipeline->writeLength == 0) break;
+
+            pipeline->writeComplete = false;
+            pipeline->stats->writes++;
+            if (uringSubmit(&pipeline->ring, TRANSFER_WRITE, pipeline->outputDescriptor, (char *)pipeline->writeData, pipeline->writeLength) == -1)
+            {
+                success = -1;
+                break;
+            }
+        }
+    }
+    else
+#endif
+    success = channelFinish(&pipeline->writer) == -1 ? -1 : 0;
+
+    pipeline->stats->ioNanoseconds += expandClock() - start;
+    return success;
+}
+
+/**
+ * @brief Write function of the output sink that hands full buffers to the writer
+ * @details
+ * After the previous write is finished, the data is written asynchronously;
+ * if it is the output buffer, the output continues in the spare buffer.
+ *
+ * @param target the pipeline
+ * @param data the bytes to write
+ * @param length count of bytes
+ * @return 0 on success, -1 if writing failed
+ */
+static int writeAsync(void *target, const char *data, size_t length)
+{
+    pipeline_t *pipeline = target;
+    if (finishWrite(pipeline) == -1 || startWrite(pipeline, data, length) == -1) return -1;
+
+    if (data == pipeline->output->data)
+    {
+        char *filled = pipeline->output->data;
+        pipeline->output->data = pipeline->spare;
+        pipeline->spare = filled;
+    }
+    return 0;
+}
+
+/**
+ * @brief Waits for the write in flight if it still references an input buffer
+ *
+ * @param pipeline the pipeline
+ * @param buffer the input buffer that is about to be reused
+ * @return 0 on success, -1 if writing failed
+ */
+static int releaseInput(pipeline_t *pipeline, const char *buffer)
+{
+    uintptr_t data = (uintptr_t)pipeline->writeData;
+    uintptr_t begin = (uintptr_t)buffer;
+    if (pipeline->writing && data >= begin && data < begin + EXPAND_CHUNK_SIZE) return finishWrite(pipeline);
+    return 0;
+}
+
+int expandPipeline(int inputDescriptor, const expand_config_t *config, int outputDescriptor, expand_stats_t *stats)
+{
+    uint64_t start = expandClock();
+    pipeline_t *pipeline = calloc(1, sizeof(pipeline_t));
+    expand_output_t *output = malloc(sizeof(expand_output_t));
+    char *spare = malloc(EXPAND_BUFFER_SIZE);
+    char *inputs[2] = { malloc(EXPAND_CHUNK_SIZE), malloc(EXPAND_CHUNK_SIZE) };
+    if (pipeline == NULL || output == NULL || spare == NULL || inputs[0] == NULL || inputs[1] == NULL)
+    {
+        free(pipeline);
+        free(output);
+        free(spare);
+        free(inputs[0]);
+        free(inputs[1]);
+        return -1;
+    }
+
+    expand_state_t state;
+    expandStateInit(&state, config);
+
+    /* the transfers are counted by the pipeline, not by the output */
+    pipeline->inputDescriptor = inputDescriptor;
+    pipeline->outputDescriptor = outputDescriptor;
+    pipeline->output = output;
+    pipeline->spare = spare;
+    pipeline->stats = &state.stats;
+    expand_sink_t sink = { writeAsync, pipeline };
+    expandOutputInit(output, sink, NULL);
+
+    /* prefer io_uring, else fall back to a reader and a writer thread */
+#if PIPELINE_URING
+    pipeline->uring = uringOpen(&pipeline->ring) == 0;
+#endif
+    if (!pipeline->uring)
+    {
+        channelOpen(&pipeline->reader, TRANSFER_READ, inputDescriptor);
+        channelOpen(&pipeline->writer, TRANSFER_WRITE, outputDescriptor);
+    }
+
+    /* expand the current chunk while the next one is read */
+    int current = 0;
+    int success = startRead(pipeline, inputs[current]);
+    while (success == 0)
+    {
+        ssize_t length = finishRead(pipeline);
+        if (length == -1) success = -1;
+        if (length <= 0) break;
+
+        int next = 1 - current;
+        if (releaseInput(pipeline, inputs[next]) == -1 || startRead(pipeline, inputs[next]) == -1) success = -1;
+        if (success == 0) success = expandBlock(&state, inputs[current], length, output);
+        current = next;
+    }
+
+    /* no transfer may be in flight when the buffers are released */
+    if (finishRead(pipeline) == -1) success = -1;
+    if (success == 0) success = expandFinish(&state, output);
+    if (success == 0 && expandOutputFlush(output) == -1) success = -1;
+    if (finishWrite(pipeline) == -1) success = -1;
+
+#if PIPELINE_URING
+    if (pipeline->uring) uringClose(&pipeline->ring);
+#endif
+    if (!pipeline->uring)
+    {
+        channelClose(&pipeline->reader);
+        channelClose(&pipeline->writer);
+    }
+
+    state.stats.nanoseconds = expandClock() - start;
+    if (stats != NULL) *stats = state.stats;
+    free(inputs[0]);
+    free(inputs[1]);
+    free(spare);
+    free(output);
+    free(pipeline);
+    return success;
+}
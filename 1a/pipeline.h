@@ -0,0 +1,34 @@
+/**
+ * @file pipeline.h
+ * @author Tobias Scharsching (12123692)
+ * @brief Expands pipes and terminals with reading, expanding and writing overlapped
+ * @date 2022-11-02
+ *
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "expand.h"
+
+/**
+ * @brief The count of entries of the io_uring submission queue
+ */
+#define PIPELINE_QUEUE_DEPTH 4
+
+/**
+ * @brief Expands a file descriptor with asynchronous reads and writes
+ * @details
+ * The next chunk is read while the current one is expanded, and a full output
+ * buffer is written while the next one is filled. The transfers run on io_uring
+ * if the kernel supports it, else on a reader and a writer thread with plain read/write.
+ *
+ * @param inputDescriptor the file descriptor to read from
+ * @param config the configuration of the expansion
+ * @param outputDescriptor the file descriptor to write to
+ * @param stats the counters of the expansion are stored here, may be NULL; waiting for transfers counts as I/O time
+ * @return 0 on success, -1 if reading or writing failed
+ */
+int expandPipeline(int inputDescriptor, const expand_config_t *config, int outputDescriptor, expand_stats_t *stats);
+
+#endif
@@ -0,0 +1,137 @@
+/**
+ * @file stats.c
+ * @author Tobias Scharsching (12123692)
+ * @brief Reports the counters of expansions per file and in total, as text or as JSON
+ * @date 2022-11-02
+ *
+ * The JSON report is written while files are expanded, so that nothing but the
+ * total has to be kept in memory:
+ *      { "files": [ { "file": "a.txt", "bytesIn": 123, ... }, ... ], "total": { ... } }
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "expand.h"
+#include "stats.h"
+
+/**
+ * @brief Time of an expansion that is not spent in I/O, in seconds
+ *
+ * @param stats the counters
+ * @return the expansion time; 0 if threads spent more time in I/O than the expansion took
+ */
+static double expandSeconds(const expand_stats_t *stats)
+{
+    if (stats->ioNanoseconds >= stats->nanoseconds) return 0;
+    return (stats->nanoseconds - stats->ioNanoseconds) / 1e9;
+}
+
+/**
+ * @brief Throughput of an expansion
+ *
+ * @param stats the counters
+ * @return input megabytes (2^20 bytes) per second, 0 if no time was measured
+ */
+static double throughput(const expand_stats_t *stats)
+{
+    if (stats->nanoseconds == 0) return 0;
+    return stats->bytesIn / (double)(1 << 20) / (stats->nanoseconds / 1e9);
+}
+
+/**
+ * @brief Writes a string as JSON string literal
+ *
+ * @param stream the stream to write to
+ * @param string the string
+ */
+static void writeString(FILE *stream, const char *string)
+{
+    putc('"', stream);
+    for (; *string != '\0'; string++)
+    {
+        unsigned char character = *string;
+        if (character == '"' || character == '\\') fprintf(stream, "\\%c", character);
+        else if (character < 0x20) fprintf(stream, "\\u%04x", character);
+        else putc(character, stream);
+    }
+    putc('"', stream);
+}
+
+/**
+ * @brief Writes the counters as members of a JSON object
+ *
+ * @param stream the stream to write to
+ * @param stats the counters
+ */
+static void writeCounters(FILE *stream, const expand_stats_t *stats)
+{
+    fprintf(stream, "\"bytesIn\": %llu, \"bytesOut\": %llu, \"lines\": %llu, \"tabs\": %llu, \"longestLine\": %llu, "
+        "\"reads\": %llu, \"writes\": %llu, \"seconds\": %.6f, \"ioSeconds\": %.6f, \"expandSeconds\": %.6f, "
+        "\"megabytesPerSecond\": %.1f",
+        (unsigned long long)stats->bytesIn, (unsigned long long)stats->bytesOut, (unsigned long long)stats->lines,
+        (unsigned long long)stats->tabs, (unsigned long long)stats->longestLine, (unsigned long long)stats->reads,
+        (unsigned long long)stats->writes, stats->nanoseconds / 1e9, stats->ioNanoseconds / 1e9,
+        expandSeconds(stats), throughput(stats));
+}
+
+/**
+ * @brief Prints the counters as text line to stderr
+ *
+ * @param name the name of the file, or of the total
+ * @param stats the counters
+ */
+static void printCounters(const char *name, const expand_stats_t *stats)
+{
+    fprintf(stderr, " - stats %s: %llu bytes in, %llu out, %llu lines, %llu tabs, longest line %llu, "
+        "%llu reads, %llu writes, %.3f ms io, %.3f ms expansion, %.1f MB/s\n",
+        name, (unsigned long long)stats->bytesIn, (unsigned long long)stats->bytesOut,
+        (unsigned long long)stats->lines, (unsigned long long)stats->tabs, (unsigned long long)stats->longestLine,
+        (unsigned long long)stats->reads, (unsigned long long)stats->writes,
+        stats->ioNanoseconds / 1e6, expandSeconds(stats) * 1e3, throughput(stats));
+}
+
+int statsOpen(stats_report_t *report, const char *path)
+{
+    memset(report, 0, sizeof(stats_report_t));
+    report->start = expandClock();
+    if (path == NULL) return 0;
+
+    report->json = fopen(path, "w");
+    if (report->json == NULL) return -1;
+    fprintf(report->json, "{\n  \"files\": [");
+    return 0;
+}
+
+void statsFile(stats_report_t *report, const char *name, const expand_stats_t *stats)
+{
+    expandStatsAdd(&report->total, stats);
+
+    if (report->json == NULL) printCounters(name, stats);
+    else
+    {
+        fprintf(report->json, "%s\n    { \"file\": ", report->files == 0 ? "" : ",");
+        writeString(report->json, name);
+        fprintf(report->json, ", ");
+        writeCounters(report->json, stats);
+        fprintf(report->json, " }");
+    }
+    report->files++;
+}
+
+int statsClose(stats_report_t *report)
+{
+    /* files may overlap on threads, so the total time is the time since the start */
+    report->total.nanoseconds = expandClock() - report->start;
+    if (report->json == NULL)
+    {
+        printCounters("total", &report->total);
+        return 0;
+    }
+
+    fprintf(report->json, "%s],\n  \"total\": { ", report->files == 0 ? "" : "\n  ");
+    writeCounters(report->json, &report->total);
+    fprintf(report->json, " }\n}\n");
+    return fclose(report->json) == EOF ? -1 : 0;
+}
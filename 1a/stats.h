@@ -0,0 +1,53 @@
+/**
+ * @file stats.h
+ * @author Tobias Scharsching (12123692)
+ * @brief Reports the counters of expansions per file and in total, as text or as JSON
+ * @date 2022-11-02
+ *
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "expand.h"
+
+/**
+ * @brief A report that files are added to as they are expanded
+ */
+typedef struct stats_report {
+    FILE *json; /** stream the JSON report is written to, NULL for text on stderr */
+    int files; /** count of reported files */
+    uint64_t start; /** time the report was opened, from expandClock */
+    expand_stats_t total; /** sum of all files */
+} stats_report_t;
+
+/**
+ * @brief Opens a report
+ *
+ * @param report the report
+ * @param path the file the JSON report is written to, NULL for text on stderr
+ * @return 0 on success, -1 if the file could not be opened
+ */
+int statsOpen(stats_report_t *report, const char *path);
+
+/**
+ * @brief Adds the counters of a file to a report
+ *
+ * @param report the report
+ * @param name the name of the file, - for stdin
+ * @param stats the counters of the expansion of the file
+ */
+void statsFile(stats_report_t *report, const char *name, const expand_stats_t *stats);
+
+/**
+ * @brief Reports the total, with the time since the report was opened, and closes the report
+ *
+ * @param report the report
+ * @return 0 on success, -1 if the JSON report could not be written
+ */
+int statsClose(stats_report_t *report);
+
+#endif
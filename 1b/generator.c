@@ -1,15 +1,32 @@
-
 #include <errno.h>
 #include <time.h>
 #include <sys/types.h>
 #include <signal.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "solutions.h"
 #include "graph.h"
+#include "tabu.h"
+
+/**
+ * @brief How long the producer waits for a solution before it checks for termination, in milliseconds
+ */
+#define PRODUCER_POLL_MS 100
+
+/**
+ * @brief The largest count of worker threads
+ */
+#define MAX_THREADS 1024
+
+/**
+ * @brief Moves of the local search between checks of the global bound and of termination
+ */
+#define TABU_MOVES_PER_ROUND 4096
 
 /*
     set up interrupt handler
@@ -19,11 +36,179 @@ static void interrupt(int signal){
     terminate = 1;
 }
 
+/**
+ * @brief State shared by the worker threads and the producer
+ * @details
+ * workers only hand improving solutions to the producer, which is the only
+ * thread that writes to the ring buffer
+ */
+typedef struct search {
+    const graph_t *graph; /** the graph, read only */
+    const adjacency_t *adjacency; /** neighbors for the local search, NULL for random colorings */
+    struct solution_circular_buffer *solutions; /** the buffer, whose shared memory holds the global bound */
+    pthread_mutex_t lock; /** guards pending */
+    pthread_cond_t found; /** signaled when pending is set */
+    int pending_removed; /** removed edges of the best solution not yet taken by the producer, -1 if none */
+    int32_t pending[2 * SOLUTION_MAX_REMOVED]; /** vertex ids of the removed edges of that solution */
+    int stop; /** set to let the workers exit */
+    const char *program; /** program name for messages */
+} search_t;
+
+/**
+ * @brief A worker thread with its own random generator and colors
+ */
+typedef struct worker {
+    pthread_t thread; /** the thread */
+    search_t *search; /** the shared state */
+    rng_t rng; /** random generator of this worker */
+    int *colors; /** colors of the vertices for this worker */
+    uint64_t *planes; /** bit-sliced colors of 64 colorings for this worker */
+} worker_t;
+
+/**
+ * @brief Hands a solution to the producer if it still improves on the best solution
+ *
+ * @param search the shared state
+ * @param removed vertex ids of the removed edges
+ * @param removed_edges count of removed edges
+ */
+static void offer(search_t *search, const int32_t *removed, int removed_edges)
+{
+    /* claim the global bound, another worker or generator may have improved in the meantime */
+    pthread_mutex_lock(&search->lock);
+    if (claim_solution_bound(search->solutions, removed_edges))
+    {
+        printf("[%s] Found solution with %d removed edges\n", search->program, removed_edges);
+        memcpy(search->pending, removed, removed_edges * 2 * sizeof(int32_t));
+        search->pending_removed = removed_edges;
+        pthread_cond_signal(&search->found);
+    }
+    pthread_mutex_unlock(&search->lock);
+}
+
+/**
+ * @brief Tries random colorings until stopped and hands improvements to the producer
+ *
+ * @param worker the worker
+ */
+static void work_random(worker_t *worker)
+{
+    search_t *search = worker->search;
+    int32_t removed[2 * SOLUTION_MAX_REMOVED];
+
+    while (!__atomic_load_n(&search->stop, __ATOMIC_RELAXED))
+    {
+        int removed_edges = solve_3color(search->graph, worker->planes, worker->colors, &worker->rng,
+            &search->solutions->memory->best_removed, removed);
+        if (removed_edges != -1) offer(search, removed, removed_edges);
+    }
+}
+
+/**
+ * @brief Runs a local search until stopped and hands improvements to the producer
+ *
+ * @param worker the worker
+ */
+static void work_tabu(worker_t *worker)
+{
+    search_t *search = worker->search;
+    int32_t removed[2 * SOLUTION_MAX_REMOVED];
+    tabu_t tabu;
+    if (tabu_init(&tabu, search->graph, search->adjacency, &worker->rng) == -1)
+    {
+        fprintf(stderr, "[%s] ERROR: Could not allocate local search.\n", search->program);
+        return;
+    }
+
+    while (!__atomic_load_n(&search->stop, __ATOMIC_RELAXED))
+    {
+        int bound = solution_bound(search->solutions);
+
+        /* self loops conflict with every coloring, once they alone reach the bound nothing can improve */
+        if (search->adjacency->self_loops >= bound) break;
+
+        int conflicts = tabu_run(&tabu, &worker->rng, bound, TABU_MOVES_PER_ROUND);
+        if (conflicts >= bound) continue;
+
+        tabu_colors(&tabu, worker->colors);
+        offer(search, removed, coloring_conflicts(search->graph, worker->colors, conflicts, removed));
+
+        /* a coloring without conflicts can not be improved */
+        if (conflicts == 0) break;
+    }
+    tabu_free(&tabu);
+}
+
+/**
+ * @brief Runs the search engine of a worker thread
+ *
+ * @param argument the worker_t
+ * @return NULL
+ */
+static void *work(void *argument)
+{
+    worker_t *worker = argument;
+    if (worker->search->adjacency != NULL) work_tabu(worker);
+    else work_random(worker);
+    return NULL;
+}
+
 int main(int argc, char *argv[]){
 
-    if (argc < 2) 
+    /* parse options, -f reads the edge list from a file or with - from stdin, -g maps a binary graph, -n names the instance */
+    const char *edge_file = NULL, *graph_source = NULL;
+    struct solution_buffer_options options = {.instance = NULL};
+    int threads = 1;
+    bool local_search = false;
+    int option;
+    while ((option = getopt(argc, argv, "f:g:j:n:s:")) != -1)
+    {
+        switch (option)
+        {
+        case 's':
+            /* search engine: random colorings or local search */
+            local_search = strcmp(optarg, "tabu") == 0;
+            if (local_search || strcmp(optarg, "random") == 0) break;
+            fprintf(stderr, "  SYNOPSIS: %s [-n instance] [-j threads] [-s random|tabu] [-f edgefile | -g graph] [vertice1-vertice2..]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        case 'f':
+            edge_file = optarg;
+            break;
+        case 'g':
+            graph_source = optarg;
+            break;
+        case 'n':
+            options.instance = optarg;
+            break;
+        case 'j':
+        {
+            char *end;
+            errno = 0;
+            long count = strtol(optarg, &end, 10);
+            if (end != optarg && *end == '\0' && errno == 0 && count > 0 && count <= MAX_THREADS)
+            {
+                threads = count;
+                break;
+            }
+            fprintf(stderr, "[%s] ERROR: Thread count must be 1 to %d.\n", argv[0], MAX_THREADS);
+            exit(EXIT_FAILURE);
+        }
+        default:
+            fprintf(stderr, "  SYNOPSIS: %s [-n instance] [-j threads] [-s random|tabu] [-f edgefile | -g graph] [vertice1-vertice2..]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int sources = (edge_file != NULL) + (graph_source != NULL) + (optind != argc);
+    if (sources == 0)
+    {
+        fprintf(stderr, "[%s] ERROR: No edges specified.\n  SYNOPSIS: %s [-n instance] [-j threads] [-s random|tabu] [-f edgefile | -g graph] [vertice1-vertice2..]\n", argv[0], argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (sources > 1)
     {
-        fprintf(stderr, "[%s] ERROR: No edges specified.\n  SYNOPSIS: %s vertice1-vertice2..\n", argv[0], argv[0]);
+        fprintf(stderr, "[%s] ERROR: Edges are specified more than once.\n", argv[0]);
+        exit(EXIT_FAILURE);
     }
 
     /* listen for sigint or sigterm */
@@ -34,70 +219,146 @@ int main(int argc, char *argv[]){
         exit(EXIT_FAILURE);
     }
 
-    /*
-        set a random seed
-    */
-    srand((unsigned int)time(NULL));
-
-    int edge_count, vertices_count, removed_edges;
-    int best_solution = 8;
     int success = 0;
 
-    /* parse edges */
-    edge_t *edges;
-    vertex_t *vertices;
-    int res = edges_from_args(argc, argv, &edge_count, &vertices_count, &edges, &vertices);
+    /* load the graph, a binary graph is shared with all generators that map it */
+    graph_t graph;
+    int res = graph_source != NULL ? graph_load(&graph, graph_source)
+        : graph_read(&graph, edge_file, argc - optind + 1, argv + optind - 1);
     if (res == -1)
     {
-        fprintf(stderr, "[%s] ERROR: Could not parse edge list.\n  SYNOPSIS: %s vertice1-vertice2..\n", argv[0], argv[0]);
-        free(edges);
-        free(vertices);
+        fprintf(stderr, "[%s] ERROR: Could not load graph: %s\n", argv[0], strerror(errno));
         return EXIT_FAILURE;
-    }  
+    }
 
     /* open shared memory / buffer */
-    struct solution_circular_buffer* solutions = open_solution_buffer(false);
+    struct solution_circular_buffer* solutions = open_solution_buffer(false, &options);
     if (solutions == NULL)
     {
-        fprintf(stderr, "[%s] ERROR: Could not open shared memory.\n", argv[0]);
-        free(edges);
-        free(vertices);
+        fprintf(stderr, "[%s] ERROR: Could not open shared memory: %s\n", argv[0], strerror(errno));
+        graph_free(&graph);
+        return EXIT_FAILURE;
+    }
+
+    /* memory left behind by a killed supervisor would take solutions that no one reads */
+    if (!solution_supervisor_alive(solutions))
+    {
+        fprintf(stderr, "[%s] ERROR: The supervisor of the shared memory is gone.\n", argv[0]);
+        close_solution_buffer(solutions, false);
+        graph_free(&graph);
         return EXIT_FAILURE;
     }
 
+    adjacency_t adjacency;
+    if (local_search && adjacency_build(&adjacency, &graph) == -1)
+    {
+        fprintf(stderr, "[%s] ERROR: Could not allocate adjacency.\n", argv[0]);
+        close_solution_buffer(solutions, false);
+        graph_free(&graph);
+        return EXIT_FAILURE;
+    }
+
+    search_t search = {.graph = &graph, .solutions = solutions, .adjacency = local_search ? &adjacency : NULL,
+        .pending_removed = -1, .program = argv[0]};
+    pthread_mutex_init(&search.lock, NULL);
+    pthread_cond_init(&search.found, NULL);
+
     /*
-        try random solutions until terminated
+        start the workers with signals blocked, so that interrupts reach the producer
+        and wake it from waiting on the buffer
     */
-    bool writing = false;
-    while(terminate != 1 && solutions->memory->supervisor_available)
+    worker_t *workers = calloc(threads, sizeof(worker_t));
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    int started = 0;
+    uint64_t seed = (uint64_t)time(NULL) << 32 ^ (uint64_t)getpid();
+    while (workers != NULL && started < threads)
     {
-        /*
-            get a solution
-        */
-        char* solution = solve_3color(edges, vertices, edge_count, vertices_count, best_solution, &removed_edges);
+        worker_t *worker = &workers[started];
+        worker->search = &search;
+        rng_seed(&worker->rng, seed + started);
+        worker->colors = malloc(graph.vertices_count * sizeof(int));
+        worker->planes = malloc(graph.vertices_count * 2 * sizeof(uint64_t));
+        if (worker->colors == NULL || worker->planes == NULL || pthread_create(&worker->thread, NULL, work, worker) != 0)
+        {
+            free(worker->colors);
+            free(worker->planes);
+            break;
+        }
+        started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
 
-        if(removed_edges < best_solution){
-            printf("[%s] Found solution with %d removed edges %s\n", argv[0], removed_edges, solution);
+    if (started < threads)
+    {
+        fprintf(stderr, "[%s] ERROR: Could not start %d worker threads.\n", argv[0], threads);
+        success = -1;
+        terminate = 1;
+    }
 
-            /*
-                write solution to buffer
-            */
-            best_solution = removed_edges;
-            success = put_solution(solutions, solution, &writing);
-            if(success == -1)
-            {
-                terminate = 1;
-                fprintf(stderr, "[%s] ERROR: Buffer could not be written.\n", argv[0]);
-            }
+    /*
+        write improving solutions to buffer until terminated
+    */
+    pthread_mutex_lock(&search.lock);
+    while(terminate != 1 && solutions->memory->supervisor_available)
+    {
+        if (!solution_supervisor_alive(solutions))
+        {
+            fprintf(stderr, "[%s] ERROR: The supervisor is gone.\n", argv[0]);
+            success = -1;
+            break;
+        }
+
+        if (search.pending_removed == -1)
+        {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += PRODUCER_POLL_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&search.found, &search.lock, &deadline);
+            continue;
         }
 
-        free(solution);
+        int32_t solution[2 * SOLUTION_MAX_REMOVED];
+        int removed_edges = search.pending_removed;
+        memcpy(solution, search.pending, removed_edges * 2 * sizeof(int32_t));
+        search.pending_removed = -1;
+        pthread_mutex_unlock(&search.lock);
+
+        success = put_solution(solutions, solution, removed_edges);
+
+        /* an interrupt while waiting for space is a shutdown, which the loop condition notices */
+        if (success == -1 && errno == EINTR) success = 0;
+        pthread_mutex_lock(&search.lock);
+        if(success == -1)
+        {
+            terminate = 1;
+            fprintf(stderr, "[%s] ERROR: Buffer could not be written.\n", argv[0]);
+        }
     }
+    __atomic_store_n(&search.stop, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&search.lock);
 
     /* clean ressources */
-    close_solution_buffer(solutions, false, writing);
-    free(edges);
-    free(vertices);
+    int i;
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        free(workers[i].colors);
+        free(workers[i].planes);
+    }
+    free(workers);
+    pthread_mutex_destroy(&search.lock);
+    pthread_cond_destroy(&search.found);
+
+    close_solution_buffer(solutions, false);
+    if (local_search) adjacency_free(&adjacency);
+    graph_free(&graph);
 
     return success == -1 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -7,175 +7,660 @@
  * randomly assigning colors and removing edges.
  **/
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "graph.h"
 
+/* ----------       parsing and dedup of edge lists       ---------- */
+
+/**
+ * @brief Marks an empty slot of the edge hash set
+ */
+#define EMPTY_EDGE UINT64_MAX
+
+/**
+ * @brief Marks an empty slot of the vertex hash table
+ */
+#define EMPTY_VERTEX -1
+
 /**
- * @brief Find an edge out of a edge array
+ * @brief Initial count of slots of the hash tables, a power of two
+ */
+#define INITIAL_SLOTS 1024
+
+/**
+ * @brief Edges and vertices of a graph while it is parsed, with open addressing hash tables for dedup
+ */
+typedef struct graph_builder {
+    edge_t *edges; /** the distinct edges */
+    int edge_count; /** count of edges */
+    int edge_capacity; /** allocated count of edges */
+    vertex_t *vertices; /** the distinct vertices, in order of appearance */
+    int vertex_count; /** count of vertices */
+    int vertex_capacity; /** allocated count of vertices */
+    uint64_t *edge_slots; /** keys of the edges (smaller index << 32 | bigger index), or EMPTY_EDGE */
+    size_t edge_mask; /** count of edge slots - 1 */
+    int *vertex_slots; /** index of a vertex in vertices, or EMPTY_VERTEX */
+    size_t vertex_mask; /** count of vertex slots - 1 */
+} graph_builder_t;
+
+/**
+ * @brief Mixes a key to a slot hash (fibonacci hashing)
  * 
- * @param edges the edge array
- * @param id1 the id1 to search for
- * @param id2 the id2 to search for
- * @return index of the edge or -1
+ * @param key the key
+ * @return the hash, to be masked to the table size
  */
-static int get_edge(edge_t *edges, int edge_count, int id1, int id2)
+static size_t hash_key(uint64_t key)
 {
-    int i;
-    for (i = 0; i < edge_count; i++)
+    key *= 0x9E3779B97F4A7C15ULL;
+    return (size_t)(key ^ (key >> 32));
+}
+
+/**
+ * @brief Initializes an empty builder
+ * 
+ * @param builder the builder
+ * @return 0 on success, -1 if allocation failed
+ */
+static int builder_init(graph_builder_t *builder)
+{
+    memset(builder, 0, sizeof(graph_builder_t));
+    builder->edge_slots = malloc(INITIAL_SLOTS * sizeof(uint64_t));
+    builder->vertex_slots = malloc(INITIAL_SLOTS * sizeof(int));
+    if (builder->edge_slots == NULL || builder->vertex_slots == NULL) return -1;
+
+    builder->edge_mask = builder->vertex_mask = INITIAL_SLOTS - 1;
+    memset(builder->edge_slots, 0xff, INITIAL_SLOTS * sizeof(uint64_t));
+    memset(builder->vertex_slots, 0xff, INITIAL_SLOTS * sizeof(int));
+    return 0;
+}
+
+/**
+ * @brief Releases the hash tables of a builder, and on failure also its edges and vertices
+ * 
+ * @param builder the builder
+ * @param keep_graph indicates that edges and vertices were handed to the caller
+ */
+static void builder_free(graph_builder_t *builder, bool keep_graph)
+{
+    free(builder->edge_slots);
+    free(builder->vertex_slots);
+    if (keep_graph) return;
+    free(builder->edges);
+    free(builder->vertices);
+}
+
+/**
+ * @brief Grows an array by doubling if it is full
+ * 
+ * @param array pointer to the array
+ * @param capacity pointer to the allocated count of elements
+ * @param count count of used elements
+ * @param size size of an element
+ * @return 0 on success, -1 if allocation failed
+ */
+static int ensure_capacity(void **array, int *capacity, int count, size_t size)
+{
+    if (count < *capacity) return 0;
+    int grown = *capacity == 0 ? INITIAL_SLOTS : *capacity * 2;
+    void *resized = realloc(*array, grown * size);
+    if (resized == NULL) return -1;
+    *array = resized;
+    *capacity = grown;
+    return 0;
+}
+
+/**
+ * @brief Finds the dense index of a vertex id, adding the vertex if it is new
+ * @details
+ * the table is doubled when it is half full, so probe sequences stay short
+ * 
+ * @param builder the builder
+ * @param id the vertex id
+ * @return the index of the vertex, -1 if allocation failed
+ */
+static int vertex_index(graph_builder_t *builder, int id)
+{
+    size_t slot = hash_key(id) & builder->vertex_mask;
+    while (builder->vertex_slots[slot] != EMPTY_VERTEX)
     {
-        if (edges[i].id1 == id1 && edges[i].id2 == id2) return i;
-        else if (edges[i].id1 == id2 && edges[i].id2 == id1) return i;
+        if (builder->vertices[builder->vertex_slots[slot]].id == id) return builder->vertex_slots[slot];
+        slot = (slot + 1) & builder->vertex_mask;
     }
-    return -1;
+
+    if (ensure_capacity((void **)&builder->vertices, &builder->vertex_capacity, builder->vertex_count, sizeof(vertex_t)) == -1) return -1;
+    int index = builder->vertex_count++;
+    builder->vertices[index].id = id;
+    builder->vertex_slots[slot] = index;
+
+    /* rehash all vertices into a table of twice the size */
+    if ((size_t)builder->vertex_count * 2 > builder->vertex_mask)
+    {
+        size_t mask = builder->vertex_mask * 2 + 1;
+        int *slots = malloc((mask + 1) * sizeof(int));
+        if (slots == NULL) return -1;
+        memset(slots, 0xff, (mask + 1) * sizeof(int));
+
+        int i;
+        for (i = 0; i < builder->vertex_count; i++)
+        {
+            size_t target = hash_key(builder->vertices[i].id) & mask;
+            while (slots[target] != EMPTY_VERTEX) target = (target + 1) & mask;
+            slots[target] = i;
+        }
+        free(builder->vertex_slots);
+        builder->vertex_slots = slots;
+        builder->vertex_mask = mask;
+    }
+    return index;
 }
 
 /**
- * @brief Find an vertex out of a vertices array
+ * @brief Adds an edge between two vertex ids, unless it is already contained in either direction
  * 
- * @param vertex the vertices array
- * @param id the id1 to search for
- * @return index of the vertex or -1
+ * @param builder the builder
+ * @param id1 the id of the first vertex
+ * @param id2 the id of the second vertex
+ * @return 0 on success, -1 if allocation failed
  */
-static int get_vertex(vertex_t *vertices, int vertices_count, int id)
-{   
-    int i;
-    for (i=0; i < vertices_count; i++)
+static int add_edge(graph_builder_t *builder, int id1, int id2)
+{
+    int v1 = vertex_index(builder, id1);
+    int v2 = vertex_index(builder, id2);
+    if (v1 == -1 || v2 == -1) return -1;
+
+    /* the key is independent of the direction */
+    uint64_t key = v1 < v2 ? (uint64_t)v1 << 32 | v2 : (uint64_t)v2 << 32 | v1;
+    size_t slot = hash_key(key) & builder->edge_mask;
+    while (builder->edge_slots[slot] != EMPTY_EDGE)
     {
-        if (vertices[i].id == id) return i;
+        if (builder->edge_slots[slot] == key) return 0;
+        slot = (slot + 1) & builder->edge_mask;
     }
-    return -1;
+
+    if (ensure_capacity((void **)&builder->edges, &builder->edge_capacity, builder->edge_count, sizeof(edge_t)) == -1) return -1;
+    builder->edges[builder->edge_count].v1 = v1;
+    builder->edges[builder->edge_count].v2 = v2;
+    builder->edge_count++;
+    builder->edge_slots[slot] = key;
+
+    /* rehash all edge keys into a table of twice the size */
+    if ((size_t)builder->edge_count * 2 > builder->edge_mask)
+    {
+        size_t mask = builder->edge_mask * 2 + 1;
+        uint64_t *slots = malloc((mask + 1) * sizeof(uint64_t));
+        if (slots == NULL) return -1;
+        memset(slots, 0xff, (mask + 1) * sizeof(uint64_t));
+
+        size_t i;
+        for (i = 0; i <= builder->edge_mask; i++)
+        {
+            if (builder->edge_slots[i] == EMPTY_EDGE) continue;
+            size_t target = hash_key(builder->edge_slots[i]) & mask;
+            while (slots[target] != EMPTY_EDGE) target = (target + 1) & mask;
+            slots[target] = builder->edge_slots[i];
+        }
+        free(builder->edge_slots);
+        builder->edge_slots = slots;
+        builder->edge_mask = mask;
+    }
+    return 0;
 }
 
-int edges_from_args(int argc, char *argv[], int *edge_count, int *vertices_count, edge_t** _edges, vertex_t** _vertices)
+/**
+ * @brief Parses a non-negative decimal number
+ * 
+ * @param text the position to parse at
+ * @param end the end of the text
+ * @param value pointer to the int which will hold the number
+ * @return pointer behind the number, NULL if there is no number or it doesn't fit an int
+ */
+static const char *parse_number(const char *text, const char *end, int *value)
 {
-    /* init arrays with max possible size, filled with 0 */
-    int size = (argc-1);
+    if (text == end || *text < '0' || *text > '9') return NULL;
 
-    edge_t *edges = calloc(size, sizeof(edge_t));
-    vertex_t *vertices = calloc(2*size, sizeof(vertex_t));
-    int edge_pos = 0;
-    int vertex_pos = 0;
+    long long number = 0;
+    while (text < end && *text >= '0' && *text <= '9')
+    {
+        number = number * 10 + (*text++ - '0');
+        if (number > INT_MAX) return NULL;
+    }
+    *value = (int)number;
+    return text;
+}
 
-    if ( edges == NULL || vertices == NULL) return -1;
+/**
+ * @brief Checks if a character separates edges
+ * 
+ * @param c the character
+ * @return true for whitespace and commas
+ */
+static bool is_separator(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == ',';
+}
 
-    /* loop through arguments and set add vertices */
-    int i;
-    for (i = 1; i < argc; i++)
+/**
+ * @brief Parses edges of the form id1-id2, separated by whitespace or commas, and adds them to a builder
+ * 
+ * @param builder the builder
+ * @param text the edge list
+ * @param end the end of the edge list
+ * @return 0 on success, -1 if the list is malformed or allocation failed
+ */
+static int parse_edges(graph_builder_t *builder, const char *text, const char *end)
+{
+    while (true)
     {
-        char *param = argv[i];
+        while (text < end && is_separator(*text)) text++;
+        if (text == end) return 0;
 
-        /* split input param */
-        char *left = strtok(param, "-");
-        char *right = strtok(NULL, "-");
+        int id1, id2;
+        text = parse_number(text, end, &id1);
+        if (text == NULL || text == end || *text++ != '-') return -1;
+        text = parse_number(text, end, &id2);
+        if (text == NULL || (text < end && !is_separator(*text))) return -1;
 
-        /* check if edge could be parsed */
-        if (left == NULL || right == NULL) {
-            return -1;
-        }
+        if (add_edge(builder, id1, id2) == -1) return -1;
+    }
+}
 
-        /* convert to int - precondition that its convertable! */
-        long int num_left, num_right;
-        num_left = strtol(left, NULL, 10);
-        num_right = strtol(right, NULL, 10);
+/**
+ * @brief Hands the edges and vertices of a builder to the caller, or releases them on failure
+ * 
+ * @param builder the builder
+ * @param success result of the parsing
+ * @return success
+ */
+static int finish_graph(graph_builder_t *builder, int success, int *edge_count, int *vertices_count, edge_t** _edges, vertex_t** _vertices)
+{
+    builder_free(builder, success == 0);
+    *_edges = success == 0 ? builder->edges : NULL;
+    *_vertices = success == 0 ? builder->vertices : NULL;
+    *edge_count = success == 0 ? builder->edge_count : 0;
+    *vertices_count = success == 0 ? builder->vertex_count : 0;
+    return success;
+}
 
-        /* increment so that 0-bindexe dont conflict with empty-value */
-        num_left++;
-        num_right++;
+int edges_from_args(int argc, char *argv[], int *edge_count, int *vertices_count, edge_t** _edges, vertex_t** _vertices)
+{
+    graph_builder_t builder;
+    int success = builder_init(&builder);
 
-        /* check if already contains edges with these vertices */
-        if (get_edge(edges, size, num_left, num_right) == -1) 
-        {
-            edge_t edge;
-            edge.id1 = num_left;
-            edge.id2 = num_right;
-            edges[edge_pos++] = edge;
-        }
+    /* every argument holds one or more edges */
+    int i;
+    for (i = 1; success == 0 && i < argc; i++)
+    {
+        success = parse_edges(&builder, argv[i], argv[i] + strlen(argv[i]));
+    }
+
+    return finish_graph(&builder, success, edge_count, vertices_count, _edges, _vertices);
+}
 
-        /* check if left vertex is added */
-        int vleft = get_vertex(vertices, 2*size, num_left);
-        if (vleft == -1) 
+int edges_from_stream(FILE *stream, int *edge_count, int *vertices_count, edge_t** _edges, vertex_t** _vertices)
+{
+    graph_builder_t builder;
+    int success = builder_init(&builder);
+
+    /* read the whole list in big blocks, so that the parser never sees an edge split between reads */
+    size_t length = 0, capacity = 1 << 20;
+    char *text = malloc(capacity);
+    if (text == NULL) success = -1;
+    while (success == 0)
+    {
+        if (length == capacity)
         {
-            vertex_t vertex;
-            vertex.id = num_left;
-            vertices[vertex_pos++] = vertex;
+            char *grown = realloc(text, capacity * 2);
+            if (grown == NULL)
+            {
+                success = -1;
+                break;
+            }
+            text = grown;
+            capacity *= 2;
         }
 
-        /* check if right vertex is added */
-        int vright = get_vertex(vertices, 2*size, num_right);
-        if (vright == -1) 
+        size_t count = fread(text + length, 1, capacity - length, stream);
+        length += count;
+        if (count == 0) break;
+    }
+    if (ferror(stream)) success = -1;
+
+    if (success == 0) success = parse_edges(&builder, text, text + length);
+    free(text);
+
+    return finish_graph(&builder, success, edge_count, vertices_count, _edges, _vertices);
+}
+
+/* ----------       binary graph images       ---------- */
+
+/**
+ * @brief Computes the size of the binary image of a graph
+ * 
+ * @param vertices_count count of vertices
+ * @param edge_count count of edges
+ * @return the size in bytes
+ */
+static size_t image_size(size_t vertices_count, size_t edge_count)
+{
+    return sizeof(graph_header_t) + vertices_count * (sizeof(int32_t) + sizeof(uint32_t)) + edge_count * sizeof(edge_t);
+}
+
+/**
+ * @brief Points the arrays of a graph into its image
+ * 
+ * @param graph the graph, with image set
+ */
+static void attach_image(graph_t *graph)
+{
+    const graph_header_t *header = graph->image;
+    graph->vertices_count = header->vertices_count;
+    graph->edge_count = header->edge_count;
+    graph->ids = (const int32_t *)(header + 1);
+    graph->edges = (const edge_t *)(graph->ids + graph->vertices_count);
+    graph->degrees = (const uint32_t *)(graph->edges + graph->edge_count);
+}
+
+int graph_from_edges(graph_t *graph, int edge_count, int vertices_count, const edge_t *edges, const vertex_t *vertices)
+{
+    memset(graph, 0, sizeof(graph_t));
+    graph->size = image_size(vertices_count, edge_count);
+    graph->image = calloc(1, graph->size);
+    if (graph->image == NULL) return -1;
+
+    graph_header_t *header = graph->image;
+    strcpy(header->magic, GRAPH_MAGIC);
+    header->version = GRAPH_VERSION;
+    header->vertices_count = vertices_count;
+    header->edge_count = edge_count;
+
+    int32_t *ids = (int32_t *)(header + 1);
+    edge_t *image_edges = (edge_t *)(ids + vertices_count);
+    uint32_t *degrees = (uint32_t *)(image_edges + edge_count);
+
+    int i;
+    for (i = 0; i < vertices_count; i++) ids[i] = vertices[i].id;
+    memcpy(image_edges, edges, edge_count * sizeof(edge_t));
+    for (i = 0; i < edge_count; i++)
+    {
+        degrees[edges[i].v1]++;
+        degrees[edges[i].v2]++;
+    }
+
+    attach_image(graph);
+    return 0;
+}
+
+/**
+ * @brief Opens the file or shared memory object named by a graph source or target
+ * 
+ * @param name the path of the file, or shm: followed by the name of the shared memory object
+ * @param flags flags of open
+ * @return the file descriptor, -1 on error
+ */
+static int open_image(const char *name, int flags)
+{
+    size_t prefix = strlen(GRAPH_SHM_PREFIX);
+    if (strncmp(name, GRAPH_SHM_PREFIX, prefix) == 0) return shm_open(name + prefix, flags, 0644);
+    return open(name, flags, 0644);
+}
+
+int graph_save(const graph_t *graph, const char *target)
+{
+    int fd = open_image(target, O_RDWR | O_CREAT | O_TRUNC);
+    if (fd == -1) return -1;
+
+    /* size first, so that shared memory objects are allocated in one step */
+    int success = ftruncate(fd, graph->size);
+    size_t written = 0;
+    while (success == 0 && written < graph->size)
+    {
+        ssize_t count = pwrite(fd, (const char *)graph->image + written, graph->size - written, written);
+        if (count == -1 && errno == EINTR) continue;
+        if (count <= 0) success = -1;
+        else written += count;
+    }
+
+    if (close(fd) == -1) success = -1;
+    return success;
+}
+
+int graph_load(graph_t *graph, const char *source)
+{
+    memset(graph, 0, sizeof(graph_t));
+    int fd = open_image(source, O_RDONLY);
+    if (fd == -1) return -1;
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(graph_header_t))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *image = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) return -1;
+
+    /* a graph is only valid if its counts describe exactly the mapped size */
+    const graph_header_t *header = image;
+    if (memcmp(header->magic, GRAPH_MAGIC, sizeof(GRAPH_MAGIC)) != 0 || header->version != GRAPH_VERSION
+        || header->vertices_count > INT_MAX || header->edge_count > INT_MAX
+        || image_size(header->vertices_count, header->edge_count) != (size_t)info.st_size)
+    {
+        munmap(image, info.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    graph->image = image;
+    graph->size = info.st_size;
+    graph->mapped = true;
+    attach_image(graph);
+
+    /* every edge has to refer to vertices of the graph */
+    int i;
+    for (i = 0; i < graph->edge_count; i++)
+    {
+        if ((unsigned)graph->edges[i].v1 >= (unsigned)graph->vertices_count || (unsigned)graph->edges[i].v2 >= (unsigned)graph->vertices_count)
         {
-            vertex_t vertex;
-            vertex.id = num_right;
-            vertices[vertex_pos++] = vertex;
+            graph_free(graph);
+            errno = EINVAL;
+            return -1;
         }
     }
-
-    *edge_count = edge_pos;
-    *vertices_count = vertex_pos;
-    *_vertices = vertices;
-    *_edges = edges;
     return 0;
 }
 
-char* solve_3color(edge_t *edges, vertex_t *vertices, int edges_count, int vertices_count, int max_removed_edges, int *removed_edges){
+void graph_free(graph_t *graph)
+{
+    if (graph->image == NULL) return;
+    if (graph->mapped) munmap(graph->image, graph->size);
+    else free(graph->image);
+    graph->image = NULL;
+}
+
+int graph_read(graph_t *graph, const char *edge_file, int argc, char *argv[])
+{
+    int edge_count, vertices_count, success;
+    edge_t *edges;
+    vertex_t *vertices;
+
+    memset(graph, 0, sizeof(graph_t));
+    if (edge_file == NULL)
+    {
+        success = edges_from_args(argc, argv, &edge_count, &vertices_count, &edges, &vertices);
+    }
+    else
+    {
+        FILE *stream = strcmp(edge_file, "-") == 0 ? stdin : fopen(edge_file, "r");
+        if (stream == NULL) return -1;
+        success = edges_from_stream(stream, &edge_count, &vertices_count, &edges, &vertices);
+        if (stream != stdin) fclose(stream);
+    }
+
+    if (success == 0 && edge_count == 0) success = -1;
+    if (success == 0) success = graph_from_edges(graph, edge_count, vertices_count, edges, vertices);
+    else errno = EINVAL;
+
+    free(edges);
+    free(vertices);
+    return success;
+}
+
+/* ----------       solving       ---------- */
+
+void rng_seed(rng_t *rng, uint64_t seed)
+{
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        rng->s[i] = z ^ (z >> 31);
+    }
+}
+
+/**
+ * @brief Counts the colorings of the lanes that have at least bound conflicts
+ * @details
+ * the counters are bit-sliced, counter[j] holds bit j of the conflict count of every lane
+ * 
+ * @param counter the counter planes
+ * @param bits count of counter planes
+ * @param bound the bound to compare against
+ * @return mask of lanes whose count is >= bound
+ */
+static uint64_t lanes_at_least(const uint64_t *counter, int bits, int bound)
+{
+    /* compare from the most significant bit, lanes are decided at their first differing bit */
+    uint64_t greater = 0, equal = ~0ULL;
+    int j;
+    for (j = bits - 1; j >= 0; j--)
+    {
+        uint64_t bit = (bound >> j) & 1 ? ~0ULL : 0;
+        greater |= equal & counter[j] & ~bit;
+        equal &= ~(counter[j] ^ bit);
+    }
+    return greater | equal;
+}
+
+int solve_3color(const graph_t *graph, uint64_t *planes, int *colors, rng_t *rng, const int *bound, int32_t *removed){
+
+    const edge_t *edges = graph->edges;
+    int max_removed_edges = __atomic_load_n(bound, __ATOMIC_RELAXED);
+    if (max_removed_edges <= 0) return -1;
 
     /*
-        set a new random color to each vertex
+        set a new random color in each lane of each vertex, the color is the 2 bit value
+        of the high and the low plane; lanes that drew the unused value 3 draw again
     */
     int i;
-    for (i = 0; i < vertices_count; i++)
+    for (i = 0; i < graph->vertices_count; i++)
     {
-        vertices[i].color = 1 + random() % 3;
+        uint64_t high = rng_next(rng), low = rng_next(rng);
+        uint64_t invalid = high & low;
+        while (invalid != 0)
+        {
+            uint64_t high_again = rng_next(rng), low_again = rng_next(rng);
+            high = (high & ~invalid) | (high_again & invalid);
+            low = (low & ~invalid) | (low_again & invalid);
+            invalid = high & low;
+        }
+        planes[2 * i] = high;
+        planes[2 * i + 1] = low;
     }
 
-    /* 
-        remove edges
+    /*
+        count conflicts per lane with a bit-sliced counter that is wide enough for the bound;
+        lanes that reach the bound are dropped, and the pass ends when no lane is left
     */
-    int removed_length = 0;
-    int removed[edges_count];
-    for (i = 0; i < edges_count && removed_length < max_removed_edges; i++)
+    int bits = 1;
+    while (bits < 31 && (1 << bits) <= max_removed_edges) bits++;
+    uint64_t counter[32] = {0};
+    uint64_t alive = ~0ULL;
+
+    for (i = 0; i < graph->edge_count && alive != 0; i++)
     {
-        int v1 = get_vertex(vertices, vertices_count, edges[i].id1);
-        int v2 = get_vertex(vertices, vertices_count, edges[i].id2);
+        const uint64_t *p1 = &planes[2 * edges[i].v1], *p2 = &planes[2 * edges[i].v2];
+        uint64_t carry = ~((p1[0] ^ p2[0]) | (p1[1] ^ p2[1])) & alive;
 
-        if (vertices[v1].color == vertices[v2].color)
+        int j;
+        for (j = 0; j < bits && carry != 0; j++)
         {
-            removed[removed_length++] = i;
+            uint64_t next = counter[j] & carry;
+            counter[j] ^= carry;
+            carry = next;
+        }
+        alive &= ~carry;    // a carry out of the counter means the count is past the bound
+
+        /*
+            checking the bound costs a compare per counter bit, so do it once per 64 edges;
+            the bound may have been lowered by other searches in the meantime
+        */
+        if ((i & 63) == 63)
+        {
+            int current = __atomic_load_n(bound, __ATOMIC_RELAXED);
+            if (current < max_removed_edges) max_removed_edges = current;
+            alive &= ~lanes_at_least(counter, bits, max_removed_edges);
         }
     }
+    alive &= ~lanes_at_least(counter, bits, max_removed_edges);
+    if (alive == 0) return -1;
 
-    /*
-        calculate needed string length
-    */
-    int solution_length = 0;
-    for(i = 0; i < removed_length; i++){
-        solution_length += snprintf(NULL,0, "%d", edges[removed[i]].id1);    // vertex 1
-        solution_length++;                                          // connection sign
-        solution_length += snprintf(NULL,0, "%d", edges[removed[i]].id2);    // vertex 2
-        if(i != removed_length - 1) solution_length++;              // separator sign
+    /* take the lane with the fewest conflicts */
+    int best_lane = -1, best_count = max_removed_edges;
+    uint64_t lanes;
+    for (lanes = alive; lanes != 0; lanes &= lanes - 1)
+    {
+        int lane = __builtin_ctzll(lanes);
+        int count = 0, j;
+        for (j = 0; j < bits; j++) count |= (int)((counter[j] >> lane) & 1) << j;
+        if (count < best_count)
+        {
+            best_count = count;
+            best_lane = lane;
+        }
     }
 
-    /*
-        build solution string
-    */
-    char *solution = malloc(solution_length + 1);
-    solution[solution_length] = '\0';
+    for (i = 0; i < graph->vertices_count; i++)
+    {
+        colors[i] = 1 + (int)((planes[2 * i] >> best_lane & 1) << 1 | (planes[2 * i + 1] >> best_lane & 1));
+    }
+    return coloring_conflicts(graph, colors, max_removed_edges, removed);
+}
 
-    if(solution == NULL) return NULL;
+int coloring_conflicts(const graph_t *graph, const int *colors, int max_removed_edges, int32_t *removed){
 
-    char *ptr = solution;
+    const edge_t *edges = graph->edges;
+    const int32_t *ids = graph->ids;
+    int i;
 
-    for (i = 0; i < removed_length; i++)
+    /* 
+        remove edges, as pairs of vertex ids so that they can be reported without the graph
+    */
+    int removed_length = 0;
+    for (i = 0; i < graph->edge_count && removed_length < max_removed_edges; i++)
     {
-        ptr += sprintf(ptr, "%d", edges[i].id1-1); // decrement because of earlier 0-val-protection
-        ptr += sprintf(ptr, "-");
-        ptr += sprintf(ptr, "%d", edges[i].id2-1);
-        if (i != removed_length - 1) ptr += sprintf(ptr, " ");
+        if (colors[edges[i].v1] == colors[edges[i].v2])
+        {
+            removed[2 * removed_length] = ids[edges[i].v1];
+            removed[2 * removed_length + 1] = ids[edges[i].v2];
+            removed_length++;
+        }
     }
 
-    *removed_edges = removed_length;
-    return solution;
+    return removed_length;
 }
@@ -10,24 +10,113 @@
 #ifndef GRAPH_H
 #define GRAPH_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
 /**
  * @brief Structure that connects two vertices, independent of drection
+ * @details
+ * holds the dense indices of the vertices in the vertices array, not their ids
  */
 typedef struct edge {
-    int id1;
-    int id2;
+    int v1;
+    int v2;
 } edge_t;
 
 /**
- * @brief Structure that describes the vertex color
+ * @brief Structure that describes a vertex
  */
 typedef struct vertex {
-    int id;
-    int color;
+    int id; /** id of the vertex as given in the edge list */
 } vertex_t;
 
+/**
+ * @brief Magic bytes at the start of a binary graph
+ */
+#define GRAPH_MAGIC "3COLGRF"
+
+/**
+ * @brief Version of the binary graph layout
+ */
+#define GRAPH_VERSION 1
+
+/**
+ * @brief Prefix of a graph source or target that names a shared memory object instead of a file
+ */
+#define GRAPH_SHM_PREFIX "shm:"
+
+/**
+ * @brief Header of a binary graph
+ * @details
+ * the header is followed by the vertex ids (int32_t[vertices_count]), the edges with dense
+ * indices (edge_t[edge_count]) and the vertex degrees (uint32_t[vertices_count]), all in
+ * native byte order, so that the image can be used in place after mapping it
+ */
+typedef struct graph_header {
+    char magic[8]; /** GRAPH_MAGIC, NUL terminated */
+    uint32_t version; /** GRAPH_VERSION */
+    uint32_t vertices_count; /** count of vertices */
+    uint32_t edge_count; /** count of edges */
+    uint32_t reserved; /** 0, pads the header to 8 byte alignment */
+} graph_header_t;
+
+/**
+ * @brief A read only graph in the binary layout, either mapped from a file or shared memory object or built in memory
+ */
+typedef struct graph {
+    int edge_count; /** count of edges */
+    int vertices_count; /** count of vertices */
+    const int32_t *ids; /** id of each vertex as given in the edge list */
+    const edge_t *edges; /** the edges, with dense vertex indices */
+    const uint32_t *degrees; /** count of edges of each vertex */
+    void *image; /** the binary image, starting with the header */
+    size_t size; /** size of the image in bytes */
+    bool mapped; /** image is mapped, else allocated */
+} graph_t;
+
+/**
+ * @brief State of a xoshiro256** random generator, one per thread
+ */
+typedef struct rng {
+    uint64_t s[4];
+} rng_t;
+
+/**
+ * @brief Seeds a random generator, expanding the seed with splitmix64
+ * 
+ * @param rng the generator
+ * @param seed the seed, distinct per thread
+ */
+void rng_seed(rng_t *rng, uint64_t seed);
+
+/**
+ * @brief Draws the next 64 random bits
+ * 
+ * @param rng the generator
+ * @return the random bits
+ */
+static inline uint64_t rng_next(rng_t *rng)
+{
+    uint64_t *s = rng->s;
+    uint64_t result = s[1] * 5;
+    result = (result << 7 | result >> 57) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = s[3] << 45 | s[3] >> 19;
+    return result;
+}
+
 /**
  * @brief Parses the argv and argc of a program to a vertice and edge array
+ * @details
+ * vertex ids are remapped once to dense indices 0..vertices_count-1, in order of appearance;
+ * edges refer to vertices by these indices so that no lookup is needed when solving
  * 
  * @param argc arc program arg count
  * @param argv argv program arg vals
@@ -36,16 +125,97 @@ typedef struct vertex {
 int edges_from_args(int argc, char *argv[], int *edge_count, int *vertices_count, edge_t** _edges, vertex_t** _vertices);
 
 /**
- * @brief Solves the 3color problem in a graph by assigning random colors and removing edges
+ * @brief Reads an edge list of the form vertice1-vertice2, separated by whitespace or commas, from a stream
+ * @details
+ * vertices and edges are remapped and deduplicated as by edges_from_args, with hash sets so that
+ * loading is linear in the count of edges
+ * 
+ * @param stream the stream to read, e.g. a file or stdin
+ * @param edge_count pointer to the int which will hold the count of edges
+ * @param vertices_count pointer to the int which will hold the count of vertices
+ * @param _edges pointer which will hold the edges array, NULL on error
+ * @param _vertices pointer which will hold the vertices array, NULL on error
+ * @return 0 on success, -1 if reading or parsing failed
+ */
+int edges_from_stream(FILE *stream, int *edge_count, int *vertices_count, edge_t** _edges, vertex_t** _vertices);
+
+/**
+ * @brief Packs parsed edges and vertices into the binary layout, with a degree table
+ * 
+ * @param graph the graph which will hold the allocated image
+ * @param edge_count count of edges
+ * @param vertices_count count of vertices
+ * @param edges the edges, with dense vertex indices
+ * @param vertices the vertices
+ * @return 0 on success, -1 if allocation failed
+ */
+int graph_from_edges(graph_t *graph, int edge_count, int vertices_count, const edge_t *edges, const vertex_t *vertices);
+
+/**
+ * @brief Parses an edge list from a file, stdin or program arguments into the binary layout
+ * 
+ * @param graph the graph which will hold the allocated image
+ * @param edge_file the edge list file, - for stdin, NULL to parse the arguments
+ * @param argc argument count, the first argument is skipped like a program name
+ * @param argv argument values
+ * @return 0 on success, -1 if the file could not be read or the list is malformed or empty
+ */
+int graph_read(graph_t *graph, const char *edge_file, int argc, char *argv[]);
+
+/**
+ * @brief Writes the binary image of a graph to a file or, with GRAPH_SHM_PREFIX, to a shared memory object
+ * 
+ * @param graph the graph
+ * @param target the path of the file, or shm: followed by the name of the shared memory object
+ * @return 0 on success, -1 if creating or writing failed
+ */
+int graph_save(const graph_t *graph, const char *target);
+
+/**
+ * @brief Maps a binary graph read only from a file or, with GRAPH_SHM_PREFIX, from a shared memory object
+ * @details
+ * all processes that load the same source share one physical copy of the graph
+ * 
+ * @param graph the graph which will refer to the mapping
+ * @param source the path of the file, or shm: followed by the name of the shared memory object
+ * @return 0 on success, -1 if the source could not be mapped or is no valid binary graph
+ */
+int graph_load(graph_t *graph, const char *source);
+
+/**
+ * @brief Releases the image of a graph
+ * 
+ * @param graph the graph
+ */
+void graph_free(graph_t *graph);
+
+/**
+ * @brief Lists the edges whose vertices have the same color, which have to be removed for a 3-coloring
+ * 
+ * @param graph the graph
+ * @param colors color of each vertex
+ * @param max_removed_edges the maximal count of edges to list
+ * @param removed array of 2 * max_removed_edges, which will hold the vertex ids of each listed edge
+ * @return the count of listed edges
+ */
+int coloring_conflicts(const graph_t *graph, const int *colors, int max_removed_edges, int32_t *removed);
+
+/**
+ * @brief Solves the 3color problem in a graph by assigning 64 random colorings at once and removing edges
+ * @details
+ * the colorings are bit-sliced, every vertex has a high and a low plane whose bits in one lane
+ * form the color of that lane; one pass over the edges counts the conflicts of all lanes with
+ * XOR/AND, and ends early once every lane has reached the bound
  * 
- * @param edges pointer to the edges array
- * @param vertices pointer to the vertices array
- * @param edges_count count of edges in the array
- * @param vertices_count count of vertices in the array
- * @param max_removed_edges the maximal allowed count of removed edges to get a solution
- * @param removed_edges pointer to the int which will hold the amount of removed edges
- * @return char* pointer to a array that holds the solution if format v1-v2 v3-v4 ..
+ * @param graph the graph
+ * @param planes array of 2 * vertices_count planes, owned by the caller
+ * @param colors array of vertices_count colors, owned by the caller, which will hold the best coloring
+ * @param rng the random generator of the calling thread
+ * @param bound the count of removed edges a solution has to be below, read atomically during the
+ * pass so that a bound lowered by other searches ends the pass early; may be in shared memory
+ * @param removed array of 2 * bound, which will hold the vertex ids of each removed edge
+ * @return the count of removed edges, -1 if no lane is below the bound
  */
-char* solve_3color(edge_t *edges, vertex_t *vertices, int edges_count, int vertices_count, int max_removed_edges, int *removed_edges);
+int solve_3color(const graph_t *graph, uint64_t *planes, int *colors, rng_t *rng, const int *bound, int32_t *removed);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,63 @@
+/**
+ * @file graphconv.c
+ * @author Tobias Scharsching e12123692@student.tuwien.ac.at
+ * @date 11.11.2022
+ *
+ * @brief Converts an edge list once to a binary graph that generators map with -g,
+ * so that they share one parsed copy of the graph.
+ **/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "graph.h"
+
+int main(int argc, char *argv[]){
+
+    /* parse options, -f reads the edge list from a file or with - from stdin */
+    const char *edge_file = NULL, *target = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "f:o:")) != -1)
+    {
+        switch (option)
+        {
+        case 'f':
+            edge_file = optarg;
+            break;
+        case 'o':
+            target = optarg;
+            break;
+        default:
+            target = NULL;
+            optind = argc + 1;
+            break;
+        }
+    }
+
+    if (target == NULL || optind > argc || (edge_file == NULL) == (optind == argc))
+    {
+        fprintf(stderr, "  SYNOPSIS: %s -o graphfile|shm:name (-f edgefile | vertice1-vertice2..)\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    graph_t graph;
+    if (graph_read(&graph, edge_file, argc - optind + 1, argv + optind - 1) == -1)
+    {
+        fprintf(stderr, "[%s] ERROR: Could not read edge list: %s\n", argv[0], strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (graph_save(&graph, target) == -1)
+    {
+        fprintf(stderr, "[%s] ERROR: Could not write %s: %s\n", argv[0], target, strerror(errno));
+        graph_free(&graph);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "[%s] Wrote %d vertices and %d edges to %s\n", argv[0], graph.vertices_count, graph.edge_count, target);
+    graph_free(&graph);
+    return EXIT_SUCCESS;
+}
@@ -18,53 +18,127 @@
 #include <sys/types.h> /* for ftruncate */
 #include <stdio.h> /* for memset */
 #include <string.h> /* for memset */
+#include <signal.h> /* for kill */
+#include <linux/futex.h> /* for FUTEX_* constants */
+#include <sys/syscall.h> /* for SYS_futex */
+#include <sys/stat.h> /* for fstat */
 
 #include "solutions.h"
 
-/* ----------       define constants        ---------- */
 
-/**
- * @brief The name of the shared memory which will be accessed 
- */
-#define SHARED_MEMORY_NAME "12123692_osue_1b_shared_memory" 
+/* ----------       implementation of shared memory       ---------- */
 
 /**
- * @brief The name of the semaphore that keeps track of free space
+ * @brief Maps the shared memory of the given size
+ * 
+ * @param file_descriptor the file descriptor to the shared mem file
+ * @param size size of the mapping
+ * @param huge_pages advise the kernel to back the mapping with huge pages
+ * @return the mapping, NULL if failed
  */
-#define SEMAPHORE_FREE_SPACE "12123692_osue_1b_semaphore_free_space" 
+static struct solution_memory *map_solution_memory(int file_descriptor, size_t size, bool huge_pages)
+{
+    /*
+        map file to address; NULL -> any address, flags for protection: read, write, flags for sharing: share between processes
+    */
+    struct solution_memory *sm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+    if (sm == MAP_FAILED) return NULL;
+
+    /*
+        MAP_HUGETLB only applies to anonymous and hugetlbfs mappings, not to shm objects on tmpfs;
+        these get transparent huge pages by advice. It is only advice, so failure is ignored
+    */
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) madvise(sm, size, MADV_HUGEPAGE);
+#endif
+    return sm;
+}
 
 /**
- * @brief The name of the semaphore that keeps track of used space
+ * @brief Builds the name of the shared memory of an instance
+ * 
+ * @param instance the name of the instance, NULL for the default instance
+ * @param name array of the size of solution_circular_buffer.name, which will hold the name
+ * @return 0 on success, -1 if the instance name is empty, too long or contains a slash
  */
-#define SEMAPHORE_USED_SPACE "12123692_osue_1b_semaphore_used_space"
+static int solution_memory_name(const char *instance, char *name)
+{
+    if (instance == NULL)
+    {
+        strcpy(name, SHARED_MEMORY_NAME);
+        return 0;
+    }
+
+    size_t length = strlen(instance);
+    if (length == 0 || length > SOLUTION_INSTANCE_MAX || strchr(instance, '/') != NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    sprintf(name, "%s.%s", SHARED_MEMORY_NAME, instance);
+    return 0;
+}
 
 /**
- * @brief The name of the semaphore that prevents from simulatously writing to the circbuffer
+ * @brief Tells if the supervisor that created a shared memory has died without removing it
+ * 
+ * @param file_descriptor the file descriptor to the shared mem file
+ * @return true if the memory is sized and its supervisor no longer exists or was never recorded
  */
-#define SEMAPHORE_BLOCK_WRITE "12123692_osue_1b_semaphore_block_write"
+static bool solution_memory_stale(int file_descriptor)
+{
+    /* memory that is not sized yet may belong to a supervisor that is just starting */
+    struct stat info;
+    if (fstat(file_descriptor, &info) == -1 || (size_t)info.st_size < sizeof(struct solution_memory)) return false;
 
-/* ----------       implementation of shared memory       ---------- */
+    struct solution_memory *header = mmap(NULL, sizeof(struct solution_memory), PROT_READ, MAP_SHARED, file_descriptor, 0);
+    if (header == MAP_FAILED) return false;
+    pid_t supervisor = __atomic_load_n(&header->supervisor, __ATOMIC_ACQUIRE);
+    munmap(header, sizeof(struct solution_memory));
+
+    /* kill(0, 0) would signal the own process group, a pid that was never stored is no supervisor */
+    return supervisor <= 0 || (kill(supervisor, 0) == -1 && errno == ESRCH);
+}
 
 /**
- * @brief size of a solution_memory struct
+ * @brief Removes the shared memory of an instance if its supervisor crashed
+ * 
+ * @param name the name of the shared memory
+ * @return 0 if the memory was removed, -1 if it could not be opened or is still in use (errno EEXIST)
  */
-static const int SOLUTION_MEMORY_SIZE = sizeof(struct solution_memory); // size of a solution memory struct 
+static int remove_stale_memory(const char *name)
+{
+    int file_descriptor = shm_open(name, O_RDONLY, 0);
+    if (file_descriptor == -1) return -1;
+
+    bool stale = solution_memory_stale(file_descriptor);
+    close(file_descriptor);
+    if (!stale)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+    return shm_unlink(name) == -1 && errno != ENOENT ? -1 : 0;
+}
 
 /**
  * @brief opens shared memory for solution read/write access
  * @details 
- * uses the constants sahred memory name and -size
+ * the supervisor creates the memory with the size of the options and stores it in the header,
+ * generators map the header first to learn the size
  * 
  * @param supervisor indicates whether the caller is a supervisor
+ * @param name the name of the shared memory of the instance
+ * @param options sizes of the memory if the caller is the supervisor
  * @param file_descriptor the file descriptor to the shared mem file
+ * @param mapping_size pointer to the size_t which will hold the size of the mapping
  * @return struct shared_memory* struct that holds pointers to the shared memory
  */
-static struct solution_memory *open_solution_memory(bool supervisor, int *file_descriptor)
+static struct solution_memory *open_solution_memory(bool supervisor, const char *name, const struct solution_buffer_options *options, int *file_descriptor, size_t *mapping_size)
 {
     /* 
         set flags for shm_open: 
         supervisor may open & create, but must be unique; generators can only read/write to existing  
-        and get struct size
     */
     int shm_open_flags = supervisor ? ( O_RDWR | O_CREAT | O_EXCL ) : ( O_RDWR );
 
@@ -74,74 +148,116 @@ static struct solution_memory *open_solution_memory(bool supervisor, int *file_d
         if failure, return null 
     */
 
-    *file_descriptor = shm_open(SHARED_MEMORY_NAME, shm_open_flags, 0600);
+    *file_descriptor = shm_open(name, shm_open_flags, 0600);
+
+    /* a supervisor of the instance that crashed left its memory behind, replace it once */
+    if (*file_descriptor == -1 && supervisor && errno == EEXIST && remove_stale_memory(name) == 0)
+    {
+        *file_descriptor = shm_open(name, shm_open_flags, 0600);
+    }
 
     if (*file_descriptor == -1) 
     {
-        //fprintf(stderr, "Failed to open shared mem with name %s and flags 0x%x; error: %s\n", SHARED_MEMORY_NAME, shm_open_flags, strerror(errno));
         return NULL;
     }
+
+    struct solution_memory *sm;
+    if (supervisor)
+    {
+        /*
+            lanes start at a cache line, so that the header and the data of the first lane don't share one;
+            with huge pages the size is rounded up to whole huge pages
+        */
+        size_t data_offset = (sizeof(struct solution_memory) + 63) & ~(size_t)63;
+        size_t size = data_offset + options->lane_size * SOLUTION_LANES;
+        if (options->huge_pages) size = (size + SOLUTION_HUGE_PAGE_SIZE - 1) & ~(SOLUTION_HUGE_PAGE_SIZE - 1);
+
+        /*
+            set size of shared memory file to hold the header and all lanes
+            return if on failure and close shared mem file descriptor
+        */
+        sm = ftruncate(*file_descriptor, size) == -1 ? NULL : map_solution_memory(*file_descriptor, size, options->huge_pages);
+        if (sm == NULL)
+        {
+            close(*file_descriptor);
+            shm_unlink(name);
+            return NULL;
+        }
+
+        /*
+            set init values: all lanes free and empty, with their indexes at position 0;
+            a new shm object is zeroed, so only the sizes and flags are set. The pid goes first,
+            memory without one is taken as stale by other supervisors
+        */
+        __atomic_store_n(&sm->supervisor, getpid(), __ATOMIC_RELEASE);
+        sm->data_offset = data_offset;
+        sm->lane_size = options->lane_size;
+        sm->huge_pages = options->huge_pages;
+        sm->best_removed = SOLUTION_MAX_REMOVED;
+        sm->supervisor_available = true;
+        __atomic_store_n(&sm->mapping_size, size, __ATOMIC_RELEASE);
+        *mapping_size = size;
+        return sm;
+    }
+
     /*
-        if supervisor (creating shared mem file):
-        set size of shared memory file to hold solution memory struct
-        return if on failure and close shared mem file descriptor
+        generator: map the header to read the size the supervisor chose, then map all of it;
+        memory of a crashed supervisor is treated as missing, no one would read the solutions
     */
-    if (supervisor && ftruncate(*file_descriptor, SOLUTION_MEMORY_SIZE) == -1)
+    if (solution_memory_stale(*file_descriptor))
     {
         close(*file_descriptor);
-        unlink(SHARED_MEMORY_NAME);
-        //fprintf(stderr, "Failed to set size of shared memory with name %s and memory size %d; error: %s\n", SHARED_MEMORY_NAME, SOLUTION_MEMORY_SIZE, strerror(errno));
+        errno = ENOENT;
         return NULL;
     }
-
-    /*
-        map file to address; NULL -> any address, flags for protection: read, write, flags for sharing: share between processes
-        if failed, close file descriptor and return null
-    */
-    int mmap_prot_flags = PROT_READ | PROT_WRITE;
-    int mmap_share_flag = MAP_SHARED;
-    struct solution_memory *sm = mmap(NULL, SOLUTION_MEMORY_SIZE, mmap_prot_flags, mmap_share_flag, *file_descriptor, 0);
-    if (sm == MAP_FAILED)
+    struct stat info;
+    struct solution_memory *header = NULL;
+    if (fstat(*file_descriptor, &info) == 0)
+    {
+        /* the supervisor has not sized the memory yet */
+        if ((size_t)info.st_size < sizeof(struct solution_memory)) errno = EAGAIN;
+        else header = map_solution_memory(*file_descriptor, sizeof(struct solution_memory), false);
+    }
+    if (header == NULL)
     {
         close(*file_descriptor);
-        unlink(SHARED_MEMORY_NAME);
-        //fprintf(stderr, "Failed to map shared memory; error: %s", strerror(errno));
         return NULL;
     }
 
-    /*
-        set init values of pointers (if server aka created shared memory) to position 0
-        and fill solution memory with _ indicating no-value
-    */
-    if(supervisor)
+    size_t size = __atomic_load_n(&header->mapping_size, __ATOMIC_ACQUIRE);
+    bool huge_pages = header->huge_pages;
+    munmap(header, sizeof(struct solution_memory));
+
+    /* the supervisor has not finished setting up the memory */
+    sm = size == 0 || size > (size_t)info.st_size ? NULL : map_solution_memory(*file_descriptor, size, huge_pages);
+    if (sm == NULL)
     {
-        sm->write_index = 0;
-        sm->read_index = 0;
-        sm->supervisor_available = true;
-        memset(sm->data, BLANK_SYMBOL, SOLUTION_DATA_SIZE);
+        if (size == 0) errno = EAGAIN;
+        close(*file_descriptor);
+        return NULL;
     }
-
+    *mapping_size = size;
     return sm;
 }
 
 /**
  * @brief Closes a shared solution memory
- * @details
- * uses the constants sahred memory name and -size
  * 
  * @param sm the solution memory struct
+ * @param name the name of the shared memory of the instance
+ * @param mapping_size size of the mapping
  * @param supervisor indicates if the calling process is a supervisor
  * @param file_descriptor the file descriptor to the shared mem file
  * @return int success of cleanup
  */
-static int close_solution_memory(struct solution_memory* sm, bool supervisor, int file_descriptor)
+static int close_solution_memory(struct solution_memory* sm, const char *name, size_t mapping_size, bool supervisor, int file_descriptor)
 {
     int success = 0;
 
     /*
         unmap linked shared memory
     */
-    success = munmap(sm, SOLUTION_MEMORY_SIZE) == -1 ? -1 : success;
+    success = munmap(sm, mapping_size) == -1 ? -1 : success;
     
     /*
         close file descriptor of shared memory file
@@ -151,7 +267,7 @@ static int close_solution_memory(struct solution_memory* sm, bool supervisor, in
     /*
         if supervisor: remove file that shared memory was mapped to
     */
-    success = supervisor && shm_unlink(SHARED_MEMORY_NAME) == -1 ? -1 : success;
+    success = supervisor && shm_unlink(name) == -1 ? -1 : success;
 
     return success;
 }
@@ -161,8 +277,70 @@ static int close_solution_memory(struct solution_memory* sm, bool supervisor, in
 
 static const int SOLUTION_BUFFER_SIZE = sizeof(struct solution_circular_buffer); // size of a solution buffer struct 
 
-struct solution_circular_buffer *open_solution_buffer(bool supervisor)
+/**
+ * @brief Sleeps until a futex word is woken, if it still holds the expected value
+ * 
+ * @param word the futex word in shared memory
+ * @param expected the value the word had when the caller decided to wait
+ * @return 0 if woken or the word changed, -1 if interrupted by a signal
+ */
+static int futex_wait(uint32_t *word, uint32_t expected)
+{
+    if (syscall(SYS_futex, word, FUTEX_WAIT, expected, NULL, NULL, 0) == -1 && errno != EAGAIN) return -1;
+    return 0;
+}
+
+/**
+ * @brief Wakes processes that sleep on a futex word
+ * 
+ * @param word the futex word in shared memory
+ * @param count the maximal count of processes to wake
+ */
+static void futex_wake(uint32_t *word, int count)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+/**
+ * @brief Claims a lane for the calling generator
+ * @details
+ * a lane is free if it has no owner or its owner no longer exists, e.g. because it crashed;
+ * the claim is a compare and swap, so generators that start at once get distinct lanes
+ * 
+ * @param memory the shared memory
+ * @return the lane, NULL if all lanes are in use
+ */
+static struct solution_lane *claim_lane(struct solution_memory *memory)
 {
+    pid_t self = getpid();
+    int i;
+    for (i = 0; i < SOLUTION_LANES; i++)
+    {
+        struct solution_lane *lane = &memory->lanes[i];
+        pid_t owner = __atomic_load_n(&lane->owner, __ATOMIC_ACQUIRE);
+        if (owner != 0 && (kill(owner, 0) == 0 || errno != ESRCH)) continue;
+        if (__atomic_compare_exchange_n(&lane->owner, &owner, self, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            lane->writer_waiting = 0;    // a crashed owner may have died while waiting
+            return lane;
+        }
+    }
+    errno = EBUSY;
+    return NULL;
+}
+
+struct solution_circular_buffer *open_solution_buffer(bool supervisor, const struct solution_buffer_options *options)
+{
+    struct solution_buffer_options defaults = {.instance = NULL, .lane_size = SOLUTION_DATA_SIZE, .huge_pages = false};
+    if (options == NULL) options = &defaults;
+
+    /* every solution that beats the bound has to fit, else it would be claimed but never written */
+    if (supervisor && options->lane_size < SOLUTION_MIN_DATA_SIZE)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
     /*
         alloc memory for the solution bufer,
         initialize it if not failed; try to open shared memory with functions from above
@@ -170,10 +348,15 @@ struct solution_circular_buffer *open_solution_buffer(bool supervisor)
     struct solution_circular_buffer *solutions = malloc(SOLUTION_BUFFER_SIZE);
     if (solutions == NULL) return NULL;
     
-    solutions->semaphore_block_write = NULL;
-    solutions->semaphore_free_space = NULL;
-    solutions->semaphore_used_space = NULL;
-    solutions->memory = open_solution_memory(supervisor, &solutions->file_descriptor);
+    solutions->lane = NULL;
+    solutions->next_lane = 0;
+    solutions->sequence = 0;
+    if (solution_memory_name(options->instance, solutions->name) == -1)
+    {
+        free(solutions);
+        return NULL;
+    }
+    solutions->memory = open_solution_memory(supervisor, solutions->name, options, &solutions->file_descriptor, &solutions->mapping_size);
     if (solutions->memory == NULL)
     {
         free(solutions);
@@ -181,81 +364,48 @@ struct solution_circular_buffer *open_solution_buffer(bool supervisor)
     }
 
     /*
-        initialize semaphores with name (sem_open), start val and flag depending on supervisor or not
+        a generator writes only to its own lane
     */
-    solutions->semaphore_free_space = supervisor ? 
-        sem_open(SEMAPHORE_FREE_SPACE,  O_CREAT | O_EXCL, 0600, SOLUTION_DATA_SIZE) : 
-        sem_open(SEMAPHORE_FREE_SPACE,  0);
-    solutions->semaphore_used_space = supervisor ? 
-        sem_open(SEMAPHORE_USED_SPACE,  O_CREAT | O_EXCL, 0600, 0) : 
-        sem_open(SEMAPHORE_USED_SPACE,  0);
-    solutions->semaphore_block_write = supervisor ? 
-        sem_open(SEMAPHORE_BLOCK_WRITE,  O_CREAT | O_EXCL, 0600, 1) : 
-        sem_open(SEMAPHORE_BLOCK_WRITE,  0);
-
-    /*
-        check all semaphores and do cleanup if one failed
-    */
-    if (solutions->semaphore_free_space == SEM_FAILED || solutions->semaphore_used_space == SEM_FAILED || solutions->semaphore_block_write == SEM_FAILED)
+    if (!supervisor)
     {
-        if (solutions->semaphore_free_space != SEM_FAILED){
-            sem_close(solutions->semaphore_free_space);
-            if (supervisor) sem_unlink(SEMAPHORE_FREE_SPACE);
-        }
-
-        if (solutions->semaphore_used_space != SEM_FAILED){
-            sem_close(solutions->semaphore_used_space);
-            if (supervisor) sem_unlink(SEMAPHORE_USED_SPACE);
-        }
-
-        if (solutions->semaphore_block_write != SEM_FAILED){
-            sem_close(solutions->semaphore_block_write);
-            if (supervisor) sem_unlink(SEMAPHORE_BLOCK_WRITE);
+        solutions->lane = claim_lane(solutions->memory);
+        if (solutions->lane == NULL)
+        {
+            close_solution_memory(solutions->memory, solutions->name, solutions->mapping_size, supervisor, solutions->file_descriptor);
+            free(solutions);
+            return NULL;
         }
-
-        close_solution_memory(solutions->memory, supervisor, solutions->file_descriptor);
-        free(solutions);
-        
-        return NULL;
     }
 
     return solutions;
 }
 
-int close_solution_buffer(struct solution_circular_buffer* solutions, bool supervisor, bool writing)
+int close_solution_buffer(struct solution_circular_buffer* solutions, bool supervisor)
 {
     /*
         if supervisor is terminating, set flag in shared memory so clients can terminate too 
-        and release sem-free so that waiting processes dont get deadlocked
-        else release sem-used so that supervisor doesn't get deadlocked
+        and wake all generators waiting for space so that they dont get deadlocked
+        else release the lane for the next generator
     */
     if (supervisor) 
     {
-        solutions->memory->supervisor_available = false;
-        sem_post(solutions->semaphore_free_space);
+        __atomic_store_n(&solutions->memory->supervisor_available, false, __ATOMIC_SEQ_CST);
+        int i;
+        for (i = 0; i < SOLUTION_LANES; i++)
+        {
+            __atomic_add_fetch(&solutions->memory->lanes[i].space_sequence, 1, __ATOMIC_SEQ_CST);
+            futex_wake(&solutions->memory->lanes[i].space_sequence, 1);
+        }
     }
     else 
     {
-        if (writing) sem_post(solutions->semaphore_block_write); // also indicates the superviser that the writing one terminated
-        //sem_post(solutions->semaphore_used_space);
+        __atomic_store_n(&solutions->lane->owner, 0, __ATOMIC_RELEASE);
     }
 
     /*
-        close semaphores and shared mem
-    */
-    int success = 0;
-
-    success = close_solution_memory(solutions->memory, supervisor, solutions->file_descriptor) == -1 ? -1 : success; 
-    success = sem_close(solutions->semaphore_block_write) == -1 ? -1 : success;
-    success = sem_close(solutions->semaphore_free_space) == -1 ? -1 : success;
-    success = sem_close(solutions->semaphore_used_space) == -1 ? -1 : success;
-
-    /*
-        unlink semaphores if supervisor is terminating
+        close shared mem
     */
-    success = supervisor && sem_unlink(SEMAPHORE_BLOCK_WRITE) == -1 ? -1 : success;
-    success = supervisor && sem_unlink(SEMAPHORE_FREE_SPACE) == -1 ? -1 : success;
-    success = supervisor && sem_unlink(SEMAPHORE_USED_SPACE) == -1 ? -1 : success;
+    int success = close_solution_memory(solutions->memory, solutions->name, solutions->mapping_size, supervisor, solutions->file_descriptor);
 
     /*
         free solution buffer
@@ -265,138 +415,230 @@ int close_solution_buffer(struct solution_circular_buffer* solutions, bool super
     return success;
 }
 
-int put_solution(struct solution_circular_buffer* solutions, char* solution, bool *writing)
+bool solution_supervisor_alive(struct solution_circular_buffer* solutions)
 {
-    /*
-        wait until no other processes are writing
-    */
-    *writing = false;
-    if (sem_wait(solutions->semaphore_block_write) == -1) return -1;
-    *writing = true;
-    /*
-        write solution into buffer; check if supervisor is still alive and solution string has not ended
-    */
-    int solution_index = 0;
-    while(solutions->memory->supervisor_available)
+    pid_t supervisor = __atomic_load_n(&solutions->memory->supervisor, __ATOMIC_ACQUIRE);
+    return supervisor > 0 && (kill(supervisor, 0) == 0 || errno != ESRCH);
+}
+
+int solution_bound(struct solution_circular_buffer* solutions)
+{
+    return __atomic_load_n(&solutions->memory->best_removed, __ATOMIC_ACQUIRE);
+}
+
+bool claim_solution_bound(struct solution_circular_buffer* solutions, int removed_edges)
+{
+    int current = solution_bound(solutions);
+    while (removed_edges < current)
     {
-        /* 
-            wait until there is free space in the buffer
-        */
-        if (sem_wait(solutions->semaphore_free_space) == -1)
-        {
-            sem_post(solutions->semaphore_block_write);
-            return -1;
-        } 
+        /* on failure current is reloaded, and the loop ends if another generator got at least as far */
+        if (__atomic_compare_exchange_n(&solutions->memory->best_removed, &current, removed_edges, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return true;
+    }
+    return false;
+}
 
-        /*
-            put char in the buffer and handle next indexes
-        */
-        char item;
-        if (solution_index == 0) item = SOLUTION_STARTER;
-        else if (solution_index == strlen(solution)+1) item = SOLUTION_TERMINATOR;
-        else item = solution[solution_index-1];
+/**
+ * @brief Finds the data buffer of a lane
+ * 
+ * @param memory the shared memory
+ * @param lane the lane
+ * @return the first byte of the data of the lane
+ */
+static char *lane_data(const struct solution_memory *memory, const struct solution_lane *lane)
+{
+    return (char *)memory + memory->data_offset + (lane - memory->lanes) * memory->lane_size;
+}
 
-        solutions->memory->data[solutions->memory->write_index] = item; // put current solution char
-        solutions->memory->write_index++;  // increment buffer write index 
-        solutions->memory->write_index %= SOLUTION_DATA_SIZE; // on index overflow, put to start (-> ringbuffer)
+/**
+ * @brief Copies bytes into the data buffer of a lane, wrapping at its end
+ * 
+ * @param memory the shared memory
+ * @param lane the lane
+ * @param index the buffer index to write at
+ * @param source the bytes
+ * @param length count of bytes
+ */
+static void copy_in(struct solution_memory *memory, struct solution_lane *lane, uint64_t index, const void *source, size_t length)
+{
+    char *data = lane_data(memory, lane);
+    size_t position = index % memory->lane_size;
+    size_t first = length < memory->lane_size - position ? length : memory->lane_size - position;
+    memcpy(data + position, source, first);
+    memcpy(data, (const char *)source + first, length - first);
+}
 
-        /*
-            break if all characters have been sent
-        */
-        sem_post(solutions->semaphore_used_space);
-        if (solution_index == strlen(solution)+1) break; 
+/**
+ * @brief Copies bytes out of the data buffer of a lane, wrapping at its end
+ * 
+ * @param memory the shared memory
+ * @param lane the lane
+ * @param index the buffer index to read at
+ * @param target the bytes
+ * @param length count of bytes
+ */
+static void copy_out(struct solution_memory *memory, const struct solution_lane *lane, uint64_t index, void *target, size_t length)
+{
+    const char *data = lane_data(memory, lane);
+    size_t position = index % memory->lane_size;
+    size_t first = length < memory->lane_size - position ? length : memory->lane_size - position;
+    memcpy(target, data + position, first);
+    memcpy((char *)target + first, data, length - first);
+}
 
-        /*
-            signalize there is content to read and
-            continue with incremented index
-        */
-        solution_index++;
+/**
+ * @brief Computes the checksum of a record
+ * 
+ * @param header the header, its checksum field is left out
+ * @param edges the edge pairs, header->length bytes
+ * @return the 32 bit FNV-1a hash
+ */
+static uint32_t record_checksum(const struct solution_record_header *header, const void *edges)
+{
+    struct solution_record_header unchecked = *header;
+    unchecked.checksum = 0;
+
+    uint32_t hash = 2166136261u;
+    const unsigned char *bytes = (const unsigned char *)&unchecked;
+    size_t i;
+    for (i = 0; i < sizeof(unchecked); i++) hash = (hash ^ bytes[i]) * 16777619u;
+    bytes = edges;
+    for (i = 0; i < header->length; i++) hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+int put_solution(struct solution_circular_buffer* solutions, const int32_t *edges, uint32_t removed)
+{
+    struct solution_memory *memory = solutions->memory;
+    struct solution_lane *lane = solutions->lane;
+    struct solution_record_header header = {
+        .length = removed * 2 * sizeof(int32_t),
+        .removed = removed,
+        .generator = (uint32_t)getpid(),
+        .sequence = solutions->sequence,
+    };
+    header.checksum = record_checksum(&header, edges);
+    size_t record_length = sizeof(header) + header.length;
+    if (record_length > memory->lane_size)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    /*
+        reserve the whole record: wait until the supervisor consumed enough records of this lane;
+        spin first, then sleep on the space sequence of the lane, which the supervisor
+        increments whenever it frees space in the lane and when it terminates
+    */
+    uint64_t write_index = lane->write_index;
+    int spins = 0;
+    while (write_index + record_length - __atomic_load_n(&lane->read_index, __ATOMIC_ACQUIRE) > memory->lane_size)
+    {
+        if (!__atomic_load_n(&memory->supervisor_available, __ATOMIC_ACQUIRE)) return 0;
+        if (spins++ < SOLUTION_SPIN_COUNT) continue;
+
+        /* announce the wait before checking again, so that a freeing supervisor sees it */
+        uint32_t sequence = __atomic_load_n(&lane->space_sequence, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&lane->writer_waiting, 1, __ATOMIC_SEQ_CST);
+        bool full = write_index + record_length - __atomic_load_n(&lane->read_index, __ATOMIC_SEQ_CST) > memory->lane_size;
+        int waited = full ? futex_wait(&lane->space_sequence, sequence) : 0;
+        __atomic_store_n(&lane->writer_waiting, 0, __ATOMIC_RELAXED);
+        if (waited == -1) return -1;    // interrupted, errno is EINTR and the record is not written
     }
 
     /*
-        release write lock so next process can write to buffer
+        copy the record and publish it; the supervisor is only woken if it sleeps
     */
-    sem_post(solutions->semaphore_block_write);
-    *writing = false;
+    copy_in(memory, lane, write_index, &header, sizeof(header));
+    copy_in(memory, lane, write_index + sizeof(header), edges, header.length);
+    __atomic_store_n(&lane->write_index, write_index + record_length, __ATOMIC_RELEASE);
+    solutions->sequence++;
+    __atomic_add_fetch(&memory->used_records, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&memory->reader_waiting, __ATOMIC_SEQ_CST)) futex_wake(&memory->used_records, 1);
     return 0;
 }
 
-char* read_solution(struct solution_circular_buffer* solutions, int *solution_len)
+struct solution* read_solution(struct solution_circular_buffer* solutions)
 {
-    /*
-        set initial allocation length to 64 and resize if necessairy
-    */
-    size_t current_length = 0, alloc_length = 64;
-    char* solution = malloc(sizeof(char) * alloc_length + 1);
-    if (solution == NULL) return NULL;
+    struct solution_memory *memory = solutions->memory;
 
-    /*
-        loop over buffer until a terminal symbol occurs
+    /* 
+        wait until there is a record in any lane: spin first, then sleep on the record count
     */
-    while (true)
+    int spins = 0;
+    while (__atomic_load_n(&memory->used_records, __ATOMIC_ACQUIRE) == 0)
     {
-        /* 
-            wait until there is data in the solution buffer
-        */
-        if (sem_wait(solutions->semaphore_used_space) == -1) 
-        {
-            free(solution); // free read buffer
-            return NULL;
-        }
-
-        /* 
-            read from buffer, and put in output
-            check if solution terminates, afterwards increment read index
-        */
-        solution[current_length] = solutions->memory->data[solutions->memory->read_index]; // put char from buffer to output
-        solutions->memory->data[solutions->memory->read_index] = BLANK_SYMBOL; 
-        solutions->memory->read_index++; // increment buffer read index
-        solutions->memory->read_index %= SOLUTION_DATA_SIZE; // on index overflow, put to start (-> ringbuffer)
-        
-        /*
-            break if solution ended here
-        */
-        if (solution[current_length] == SOLUTION_TERMINATOR) break;
+        if (spins++ < SOLUTION_SPIN_COUNT) continue;
 
-        /*
-            else if previous solution wasn't complete (new starting symbol), start over
-        */
-        if (current_length != 0 && solution[current_length] == SOLUTION_STARTER) 
+        /* announce the wait before checking again, so that a publishing generator sees it */
+        __atomic_store_n(&memory->reader_waiting, 1, __ATOMIC_SEQ_CST);
+        int waited = __atomic_load_n(&memory->used_records, __ATOMIC_SEQ_CST) == 0 ? futex_wait(&memory->used_records, 0) : 0;
+        __atomic_store_n(&memory->reader_waiting, 0, __ATOMIC_RELAXED);
+        if (waited == -1)
         {
-            current_length = 0;
-            alloc_length = 64;
-            free(solution);
-            solution = malloc(sizeof(char) * alloc_length);
-            solution[0] = SOLUTION_STARTER;
-        }
-
-        /*
-            resize buffer if needed and 
-            signalize next free space is ready
-        */
-        current_length++; 
-        if (current_length == alloc_length)
-        {
-            alloc_length *= 2;
-            solution = realloc(solution, sizeof(char) * alloc_length);
+            errno = EINTR;
+            return NULL;
         }
-        sem_post(solutions->semaphore_free_space); 
     }
 
-    /* 
-        check if solution is valid and contains both start and terminating character
+    /*
+        find the lane, starting behind the last one read so that no generator starves the others;
+        every count belongs to a published record, so one is found
     */
-    if (solution[0] != SOLUTION_STARTER || solution[current_length] != SOLUTION_TERMINATOR){
-        free(solution);
+    struct solution_lane *lane = NULL;
+    int i;
+    for (i = 0; i < SOLUTION_LANES && lane == NULL; i++)
+    {
+        struct solution_lane *candidate = &memory->lanes[(solutions->next_lane + i) % SOLUTION_LANES];
+        if (__atomic_load_n(&candidate->write_index, __ATOMIC_ACQUIRE) != candidate->read_index) lane = candidate;
+    }
+    if (lane == NULL)
+    {
+        /* the count was left by a damaged lane that was dropped, see below */
+        __atomic_sub_fetch(&memory->used_records, 1, __ATOMIC_RELAXED);
+        errno = EBADMSG;
         return NULL;
-    } 
+    }
+    solutions->next_lane = (lane - memory->lanes + 1) % SOLUTION_LANES;
 
-    char *result = malloc((--current_length) * sizeof(char));
-    strncpy(result, solution+1, current_length);
-    free(solution);
+    /*
+        copy the record out and free its space as a whole; a length that does not fit the lane
+        leaves no way to find the next record, so the whole lane is dropped
+    */
+    uint64_t read_index = lane->read_index;
+    uint64_t write_index = __atomic_load_n(&lane->write_index, __ATOMIC_ACQUIRE);
+    struct solution_record_header header;
+    copy_out(memory, lane, read_index, &header, sizeof(header));
+
+    struct solution *solution = NULL;
+    int error = EBADMSG;
+    if (header.length != header.removed * 2 * sizeof(int32_t) || sizeof(header) + header.length > write_index - read_index)
+    {
+        read_index = write_index;
+    }
+    else
+    {
+        solution = malloc(sizeof(struct solution) + header.length);
+        if (solution != NULL)
+        {
+            solution->removed = header.removed;
+            solution->generator = header.generator;
+            solution->sequence = header.sequence;
+            copy_out(memory, lane, read_index + sizeof(header), solution->edges, header.length);
+            if (record_checksum(&header, solution->edges) != header.checksum)
+            {
+                free(solution);
+                solution = NULL;
+            }
+        }
+        else error = ENOMEM;
+        read_index += sizeof(header) + header.length;
+    }
 
-    /* exclude starter and terminator */
-    *solution_len = current_length;
+    __atomic_store_n(&lane->read_index, read_index, __ATOMIC_SEQ_CST);
+    __atomic_sub_fetch(&memory->used_records, 1, __ATOMIC_RELAXED);
 
-    return result;
+    /* only the owner waits on the lane, so wake it only if it sleeps */
+    __atomic_add_fetch(&lane->space_sequence, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&lane->writer_waiting, __ATOMIC_SEQ_CST)) futex_wake(&lane->space_sequence, 1);
+    if (solution == NULL) errno = error;
+    return solution;
 }
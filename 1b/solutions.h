@@ -11,104 +11,225 @@
 #define SOLUTIONS_H
 
 #include <stdbool.h> /* for booleans */
-#include <semaphore.h> /* for semaphores */
+#include <stdint.h> /* for fixed size integers */
+#include <sys/types.h> /* for pid_t */
 
 #include "solutions.h"
 
 /* ----------       define constants        ---------- */
 
 /**
- * @brief A symbol that indicates that a solution sequence has ended or is not present
+ * @brief The name of the shared memory of the default instance, other instances append .instance
  */
-#define SOLUTION_TERMINATOR ']'
+#define SHARED_MEMORY_NAME "12123692_osue_1b_shared_memory"
 
 /**
- * @brief A symbol that has to be first at a solution sequence, to filter out damaged packets
+ * @brief The default size of the usable shared memory of each lane for saving solutions, in bytes
  */
-#define SOLUTION_STARTER '['
+#define SOLUTION_DATA_SIZE 1024
 
 /**
- * @brief A symbol that represents no data, = blank
+ * @brief The smallest size of the data of a lane, in bytes, which fits the largest record:
+ * the header and the vertex ids of SOLUTION_MAX_REMOVED - 1 edges
  */
-#define  BLANK_SYMBOL '_'
+#define SOLUTION_MIN_DATA_SIZE (sizeof(struct solution_record_header) + 2 * (SOLUTION_MAX_REMOVED - 1) * sizeof(int32_t))
 
 /**
- * @brief The size of the usable shared memory for saving solutions, in bytes
+ * @brief The longest name of a solution buffer instance
  */
-#define SOLUTION_DATA_SIZE 1024
+#define SOLUTION_INSTANCE_MAX 64
+
+/**
+ * @brief Huge pages are 2 MiB on x86_64; the mapping is a multiple of this if huge pages are requested
+ */
+#define SOLUTION_HUGE_PAGE_SIZE (2UL << 20)
+
+/**
+ * @brief The count of lanes, which limits the count of generators that can run at once
+ */
+#define SOLUTION_LANES 64
+
+/**
+ * @brief How often a waiting process checks a counter again before it sleeps on the futex
+ */
+#define SOLUTION_SPIN_COUNT 100
+
+/**
+ * @brief Solutions need to remove fewer edges than this to be written to the buffer
+ * @details
+ * a deliberate limit: the shared bound starts here, so that records, the mailbox of the generator
+ * and the minimal lane have a fixed size. On graphs far from 3-colorable nothing is reported
+ * until a search gets below it
+ */
+#define SOLUTION_MAX_REMOVED 8
 
 /* ----------       defines of shared memory       ---------- */
 
+/**
+ * @brief Header in front of every solution record in the buffer
+ * @details
+ * a record is the header followed by the removed edges as pairs of int32_t vertex ids;
+ * it is stored contiguously, except that it wraps at the end of the data buffer
+ */
+struct solution_record_header {
+    uint32_t length; /** length of the edge pairs in bytes */
+    uint32_t removed; /** count of removed edges */
+    uint32_t generator; /** process id of the generator */
+    uint32_t sequence; /** number of the record among those of the generator */
+    uint32_t checksum; /** FNV-1a of the header, with checksum 0, and the edge pairs */
+};
+
+/**
+ * @brief A solution as read by the supervisor
+ */
+struct solution {
+    uint32_t removed; /** count of removed edges */
+    uint32_t generator; /** process id of the generator */
+    uint32_t sequence; /** number of the solution among those of the generator */
+    int32_t edges[]; /** vertex ids of the removed edges, 2 * removed */
+};
+
+/**
+ * @brief A single producer / single consumer ring buffer, owned by one generator
+ * @details
+ * the indexes count bytes since the start and only grow, the position in the data of the lane is
+ * the index modulo lane_size of the memory; write_index - read_index is the count of used bytes.
+ * Only the owner advances write_index and only the supervisor advances read_index, so no lock is needed.
+ * The data of the lanes follows the solution_memory struct in the mapping
+ */
+struct solution_lane {
+    pid_t owner; /** process id of the generator that claimed the lane, 0 if free */
+    uint32_t space_sequence; /** futex word, incremented by the supervisor whenever it frees space in the lane */
+    uint32_t writer_waiting; /** set while the owner sleeps on space_sequence, so that only then it is woken */
+    uint64_t read_index; /** index of the next record to read, advanced by the supervisor */
+    uint64_t write_index; /** index behind the last written record, advanced by the owner */
+};
+
 /**
  * @brief struct with pointers to get access to shared memory
+ * @details
+ * processes synchronize only with atomic operations on these words and with futexes on them,
+ * so there are no kernel objects besides the shared memory itself
  */
 struct solution_memory {
-    size_t read_index; /** pointer to current buffer read position */
-    size_t write_index; /** pointer to current buffer write position */ 
+    uint64_t mapping_size; /** size of the whole mapping in bytes, set by the supervisor so that generators map the same */
+    uint64_t lane_size; /** size of the data of each lane in bytes */
+    uint64_t data_offset; /** offset of the data of the first lane from the start of the mapping */
+    bool huge_pages; /** the mapping is advised to be backed by huge pages */
+    pid_t supervisor; /** pid of the supervisor, to find memory left behind by a crashed supervisor */
+    uint32_t used_records; /** futex word, count of published records that the supervisor has not read yet */
+    uint32_t reader_waiting; /** set while the supervisor sleeps on used_records, so that only then it is woken */
     bool supervisor_available; /** indicator that the supervisor is still waiting for results */
-	char data[SOLUTION_DATA_SIZE]; /** data buffer */ 
+    int best_removed; /** fewest removed edges of any written solution, starts at SOLUTION_MAX_REMOVED and is lowered atomically by the generators */
+    struct solution_lane lanes[SOLUTION_LANES]; /** one lane per generator */
 };
 
 /* ----------       defines of solution circular buffer       ---------- */
 
+/**
+ * @brief Options of the shared memory; the sizes are chosen by the supervisor, generators take them from the shared header
+ */
+struct solution_buffer_options {
+    const char *instance; /** name of the instance, NULL for the default; supervisor and generators of a job use the same */
+    size_t lane_size; /** size of the data of each lane in bytes */
+    bool huge_pages; /** back the mapping with transparent huge pages */
+};
+
 /**
  * @brief struct that holds data to access and handle the shared solution memory 
  */
 struct solution_circular_buffer {
-    sem_t* semaphore_free_space; // semaphore to lock free space pointer
-    sem_t* semaphore_used_space; // semaphore to lock used space pointer
-    sem_t* semaphore_block_write; // semaphore to lock writing to memory
     struct solution_memory* memory; // the shared memory struct 
+    size_t mapping_size; // size of the mapping of memory
+    struct solution_lane* lane; // the lane claimed by a generator, NULL for the supervisor
+    int next_lane; // lane the supervisor looks at first for the next record
+    uint32_t sequence; // number of the next record a generator writes
     int file_descriptor; // file descriptor of the mapped shared memory
+    char name[sizeof(SHARED_MEMORY_NAME) + SOLUTION_INSTANCE_MAX + 1]; // name of the shared memory of the instance
 };
 
 /**
- * @brief opens a solution buffer from a shared memory and inits semaphores to access it
+ * @brief opens a solution buffer from a shared memory
  * @details
- * uses the constants for the write, free and used semaphore names and the solution buffer size
+ * the shared memory is named after the instance, so that independent jobs run side by side.
+ * The supervisor creates the memory with the sizes of the options, replacing memory left behind by a
+ * crashed supervisor of the same instance; generators map the size stored in the shared header.
+ * A generator claims a free lane, or the lane of a generator that died without releasing it
  * 
  * @param supervisor indicates if the caller process is the supervisor
- * @return struct solution_circular_buffer* holds semaphores and buffer struct; null if errored
+ * @param options instance and sizes of the memory, the sizes are only used by the supervisor,
+ * whose lane size has to be at least SOLUTION_MIN_DATA_SIZE;
+ * NULL for the default instance with SOLUTION_DATA_SIZE without huge pages
+ * @return struct solution_circular_buffer* holds the buffer struct; null if errored
  */
-struct solution_circular_buffer *open_solution_buffer(bool supervisor);
+struct solution_circular_buffer *open_solution_buffer(bool supervisor, const struct solution_buffer_options *options);
 
 /**
- * @brief Closes all semaphores of a solution struct and releases its memory
+ * @brief Closes the shared memory of a solution struct and releases its memory
  * @details
- * uses the constants for the write, free and used semaphore names 
+ * the supervisor wakes all waiting generators; a generator releases its lane,
+ * records it wrote before are still read by the supervisor
  * 
  * @param solution the solution struct that is to be closed
  * @param supervisor indicates if the caller process is the supervisor
- * @return int indicating success; -1 if cleanup of semaphores or memory was unsuccessful
+ * @return int indicating success; -1 if cleanup of memory was unsuccessful
+ */
+int close_solution_buffer(struct solution_circular_buffer* solutions, bool supervisor);
+
+/**
+ * @brief Tells if the supervisor that created the shared memory still exists
+ * @details
+ * a supervisor killed with SIGKILL can not clear supervisor_available, so generators check its pid
+ * 
+ * @param solutions the solution buffer
+ * @return true if the supervisor exists
+ */
+bool solution_supervisor_alive(struct solution_circular_buffer* solutions);
+
+/**
+ * @brief Reads the global bound, the count of removed edges a new solution has to be below
+ * 
+ * @param solutions the solution buffer
+ * @return the bound
+ */
+int solution_bound(struct solution_circular_buffer* solutions);
+
+/**
+ * @brief Lowers the global bound to a solution's count of removed edges, if the solution is still better
+ * @details
+ * uses compare and swap, so of generators that race with the same improvement only one wins and writes it
+ * 
+ * @param solutions the solution buffer
+ * @param removed_edges the count of removed edges of the solution
+ * @return true if the bound was lowered and the solution should be written
  */
-int close_solution_buffer(struct solution_circular_buffer* solutions, bool supervisor, bool writing);
+bool claim_solution_bound(struct solution_circular_buffer* solutions, int removed_edges);
 
 /**
- * @brief writes a solution in the buffer index
+ * @brief writes a solution in the lane of the generator as one record
  * @details
- * uses the constants for the starter, blank and termination symbols
- * Writes a solution in the buffer memory, and adds the starter symbol and terminal symbol around it to ensure complete transmission
+ * Reserves the space of the whole record at once, waiting until the supervisor freed enough,
+ * copies header and edges into the lane and publishes the record with a single atomic increment
  * 
- * @param solutions the solution_circular_buffer struct that holds semaphores and the buffer data
- * @param solution the new solution to write in the buffer, excluding starter and terminal symbol!
- * @return int success of the processing if 0, otherwise error occured
+ * @param solutions the solution_circular_buffer struct that holds the buffer data
+ * @param edges vertex ids of the removed edges, 2 * removed
+ * @param removed count of removed edges
+ * @return int success of the processing if 0, otherwise error occured; errno is EMSGSIZE if the record can never fit the buffer;
+ * EINTR if a signal interrupted the wait for space, the record is then not written
  */
-int put_solution(struct solution_circular_buffer* solutions, char* solution, bool *writing);
+int put_solution(struct solution_circular_buffer* solutions, const int32_t *edges, uint32_t removed);
 
 /**
  * @brief Reads a solution from the memory solution buffer
  * @details
- * uses the constants for the starter, blank and termination symbols and the solution buffer size
- * Handles buffer reading; where a correctly written word 
- * has to be surrounded be starter-symbol and terminator-symbol.
- * If a starter symbol occurs without the previous solution being terminated, 
- * the previous word is discarded and the new one taken.
- * This can happen when a generator crashes during sending.
+ * Waits for the next record in any lane and consumes it as a whole; lanes are visited round robin.
+ * Records whose length or checksum do not match are dropped
  * 
- * @param solutions struct that holds shared memory, indexes and semaphores to access
- * @return char* the fetched solution, including terminal symbol
+ * @param solutions struct that holds shared memory and indexes to access
+ * @return struct solution* the fetched solution, to be freed; NULL if waiting was interrupted (errno EINTR),
+ * the record was damaged (errno EBADMSG) or allocation failed
  */
-char* read_solution(struct solution_circular_buffer* solutions, int *solution_len);
+struct solution* read_solution(struct solution_circular_buffer* solutions);
 
 #endif
 
@@ -12,9 +12,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "solutions.h"
 
+/**
+ * @brief The largest size of the data of a lane that can be requested, in bytes
+ */
+#define SUPERVISOR_MAX_LANE_SIZE (64UL << 20)
+
 /*
     set up interrupt handler
 */
@@ -23,11 +29,56 @@ static void interrupt(int signal){
     terminate = 1;
 }
 
+/**
+ * @brief Parses a size in bytes with an optional K or M suffix
+ * 
+ * @param text the size
+ * @param size pointer to the size_t which will hold the size
+ * @return 0 on success, -1 if the text is no size within the limits of a lane
+ */
+static int parse_size(const char *text, size_t *size)
+{
+    char *end;
+    errno = 0;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text || errno != 0 || text[0] == '-') return -1;
+
+    if (*end == 'K' || *end == 'k') value = value > SUPERVISOR_MAX_LANE_SIZE >> 10 ? 0 : value << 10, end++;
+    else if (*end == 'M' || *end == 'm') value = value > SUPERVISOR_MAX_LANE_SIZE >> 20 ? 0 : value << 20, end++;
+    if (*end != '\0' || value < SOLUTION_MIN_DATA_SIZE || value > SUPERVISOR_MAX_LANE_SIZE) return -1;
+
+    *size = value;
+    return 0;
+}
+
 int main(int argc, char *argv[]){
 
-    if (argc > 1)
+    /* parse options, -n names the instance, -s sizes the lane of each generator, -H asks for huge pages */
+    struct solution_buffer_options options = {.instance = NULL, .lane_size = SOLUTION_DATA_SIZE, .huge_pages = false};
+    int option;
+    while ((option = getopt(argc, argv, "n:s:H")) != -1)
     {
-        fprintf(stderr, "[%s] ERROR: Too many arguments.\n  SYNOPSIS: %s\n", argv[0], argv[0]);
+        switch (option)
+        {
+        case 'n':
+            options.instance = optarg;
+            break;
+        case 's':
+            if (parse_size(optarg, &options.lane_size) == 0) break;
+            fprintf(stderr, "[%s] ERROR: Lane size must be %zu to %lu bytes.\n", argv[0], SOLUTION_MIN_DATA_SIZE, SUPERVISOR_MAX_LANE_SIZE);
+            return EXIT_FAILURE;
+        case 'H':
+            options.huge_pages = true;
+            break;
+        default:
+            fprintf(stderr, "  SYNOPSIS: %s [-n instance] [-s lanesize[K|M]] [-H]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc)
+    {
+        fprintf(stderr, "[%s] ERROR: Too many arguments.\n  SYNOPSIS: %s [-n instance] [-s lanesize[K|M]] [-H]\n", argv[0], argv[0]);
         return EXIT_FAILURE;
     }
 
@@ -41,7 +92,7 @@ int main(int argc, char *argv[]){
 
     /* open shared memory buffer */
     struct solution_circular_buffer *solutions;
-    solutions = open_solution_buffer(true);
+    solutions = open_solution_buffer(true, &options);
     if (solutions == NULL) 
     {
         fprintf(stderr, "[%s] ERROR: Buffer with shared memory couldn't be opened: %s\n", argv[0], strerror(errno));
@@ -51,26 +102,23 @@ int main(int argc, char *argv[]){
     /* listen for solutions */
     while(terminate == 0)
     {
-        int solution_length;
-        char *solution = read_solution(solutions, &solution_length);
+        struct solution *solution = read_solution(solutions);
         if (solution == NULL)
         {
-            printf("[%s] WARN: Got invalid solution\n", argv[0]);
+            if (errno != EINTR) printf("[%s] WARN: Got invalid solution\n", argv[0]);
             continue;
         }
 
-        /* count edges */
-        int count = 0;
-        int i;
-        for(i=0; i < solution_length; i++)
-        {
-            if (solution[i] == '-') count++; 
-        }
-        
-        /* print solution */
-        if (count > 0)
+        /* print solution, formatting the edges only here */
+        if (solution->removed > 0)
         {
-            printf("[%s] Solution with %d edges: %s\n", argv[0], count, solution);
+            printf("[%s] Solution with %u edges:", argv[0], solution->removed);
+            uint32_t i;
+            for (i = 0; i < solution->removed; i++)
+            {
+                printf(" %d-%d", solution->edges[2 * i], solution->edges[2 * i + 1]);
+            }
+            printf("\n");
         }
         else 
         {
@@ -82,7 +130,7 @@ int main(int argc, char *argv[]){
     }
 
     /* close shared memory buffer */
-    if (close_solution_buffer(solutions, true, false) == -1)
+    if (close_solution_buffer(solutions, true) == -1)
     {
         fprintf(stderr, "[%s] ERROR: Buffer with shared memory couldn't be closed: %s\n", argv[0], strerror(errno));
 		return EXIT_FAILURE;
@@ -0,0 +1,249 @@
+/**
+ * @file tabu.c
+ * @author Tobias Scharsching e12123692@student.tuwien.ac.at
+ * @date 11.11.2022
+ *
+ * @brief Implements the min-conflicts local search with a tabu list and restarts.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tabu.h"
+
+/**
+ * @brief Draws a random number below a limit
+ *
+ * @param rng the random generator
+ * @param limit the exclusive limit
+ * @return the number, 0..limit-1
+ */
+static uint32_t draw(rng_t *rng, uint32_t limit)
+{
+    return (uint32_t)(((rng_next(rng) >> 32) * limit) >> 32);
+}
+
+int adjacency_build(adjacency_t *adjacency, const graph_t *graph)
+{
+    memset(adjacency, 0, sizeof(adjacency_t));
+    adjacency->offsets = malloc((graph->vertices_count + 1) * sizeof(uint32_t));
+    if (adjacency->offsets == NULL) return -1;
+
+    /* the degrees count a self loop twice, which leaves unused room at the end of that vertex */
+    int i;
+    adjacency->offsets[0] = 0;
+    for (i = 0; i < graph->vertices_count; i++) adjacency->offsets[i + 1] = adjacency->offsets[i] + graph->degrees[i];
+
+    adjacency->neighbors = malloc((adjacency->offsets[graph->vertices_count] + 1) * sizeof(int32_t));
+    uint32_t *fill = malloc(graph->vertices_count * sizeof(uint32_t));
+    if (adjacency->neighbors == NULL || fill == NULL)
+    {
+        free(fill);
+        adjacency_free(adjacency);
+        return -1;
+    }
+    memcpy(fill, adjacency->offsets, graph->vertices_count * sizeof(uint32_t));
+
+    for (i = 0; i < graph->edge_count; i++)
+    {
+        int v1 = graph->edges[i].v1, v2 = graph->edges[i].v2;
+        if (v1 == v2)
+        {
+            adjacency->self_loops++;
+            continue;
+        }
+        adjacency->neighbors[fill[v1]++] = v2;
+        adjacency->neighbors[fill[v2]++] = v1;
+    }
+
+    /* close the gaps left by self loops, so that each range holds only neighbors */
+    uint32_t end = 0;
+    for (i = 0; i < graph->vertices_count; i++)
+    {
+        uint32_t begin = adjacency->offsets[i], count = fill[i] - begin;
+        memmove(&adjacency->neighbors[end], &adjacency->neighbors[begin], count * sizeof(int32_t));
+        adjacency->offsets[i] = end;
+        end += count;
+    }
+    adjacency->offsets[graph->vertices_count] = end;
+
+    free(fill);
+    return 0;
+}
+
+void adjacency_free(adjacency_t *adjacency)
+{
+    free(adjacency->offsets);
+    free(adjacency->neighbors);
+    adjacency->offsets = NULL;
+    adjacency->neighbors = NULL;
+}
+
+/**
+ * @brief Adds a vertex to or removes it from the conflicted set, according to its neighbor colors
+ *
+ * @param tabu the search
+ * @param vertex the vertex
+ */
+static void update_conflicted(tabu_t *tabu, int vertex)
+{
+    bool conflicted = tabu->neighbor_colors[3 * vertex + tabu->colors[vertex]] > 0;
+    if (conflicted && tabu->position[vertex] == -1)
+    {
+        tabu->position[vertex] = tabu->conflicted_count;
+        tabu->conflicted[tabu->conflicted_count++] = vertex;
+    }
+    else if (!conflicted && tabu->position[vertex] != -1)
+    {
+        /* fill the hole with the last vertex */
+        int last = tabu->conflicted[--tabu->conflicted_count];
+        tabu->conflicted[tabu->position[vertex]] = last;
+        tabu->position[last] = tabu->position[vertex];
+        tabu->position[vertex] = -1;
+    }
+}
+
+/**
+ * @brief Starts a search over from a random coloring
+ *
+ * @param tabu the search
+ * @param rng the random generator
+ */
+static void restart(tabu_t *tabu, rng_t *rng)
+{
+    const graph_t *graph = tabu->graph;
+    const adjacency_t *adjacency = tabu->adjacency;
+    int v;
+    for (v = 0; v < graph->vertices_count; v++) tabu->colors[v] = draw(rng, 3);
+
+    memset(tabu->neighbor_colors, 0, graph->vertices_count * 3 * sizeof(int));
+    memset(tabu->tabu_until, 0, graph->vertices_count * 3 * sizeof(uint64_t));
+    tabu->conflicts = adjacency->self_loops * 2;
+    for (v = 0; v < graph->vertices_count; v++)
+    {
+        uint32_t i;
+        for (i = adjacency->offsets[v]; i < adjacency->offsets[v + 1]; i++)
+        {
+            int neighbor = adjacency->neighbors[i];
+            tabu->neighbor_colors[3 * v + tabu->colors[neighbor]]++;
+            if (tabu->colors[neighbor] == tabu->colors[v]) tabu->conflicts++;
+        }
+    }
+    /* every conflicting edge was counted from both ends */
+    tabu->conflicts /= 2;
+
+    tabu->conflicted_count = 0;
+    for (v = 0; v < graph->vertices_count; v++)
+    {
+        tabu->position[v] = -1;
+        update_conflicted(tabu, v);
+    }
+    tabu->best = tabu->conflicts;
+    tabu->best_iteration = tabu->iteration;
+}
+
+int tabu_init(tabu_t *tabu, const graph_t *graph, const adjacency_t *adjacency, rng_t *rng)
+{
+    memset(tabu, 0, sizeof(tabu_t));
+    tabu->graph = graph;
+    tabu->adjacency = adjacency;
+
+    int n = graph->vertices_count;
+    tabu->colors = malloc(n * sizeof(int));
+    tabu->neighbor_colors = malloc(n * 3 * sizeof(int));
+    tabu->tabu_until = malloc(n * 3 * sizeof(uint64_t));
+    tabu->conflicted = malloc(n * sizeof(int));
+    tabu->position = malloc(n * sizeof(int));
+    if (tabu->colors == NULL || tabu->neighbor_colors == NULL || tabu->tabu_until == NULL
+        || tabu->conflicted == NULL || tabu->position == NULL)
+    {
+        tabu_free(tabu);
+        return -1;
+    }
+
+    restart(tabu, rng);
+    return 0;
+}
+
+void tabu_free(tabu_t *tabu)
+{
+    free(tabu->colors);
+    free(tabu->neighbor_colors);
+    free(tabu->tabu_until);
+    free(tabu->conflicted);
+    free(tabu->position);
+    memset(tabu, 0, sizeof(tabu_t));
+}
+
+/**
+ * @brief Recolors a vertex and updates the counts of its neighbors
+ *
+ * @param tabu the search
+ * @param vertex the vertex
+ * @param color the new color
+ */
+static void recolor(tabu_t *tabu, int vertex, int color)
+{
+    const adjacency_t *adjacency = tabu->adjacency;
+    int old = tabu->colors[vertex];
+    tabu->conflicts += tabu->neighbor_colors[3 * vertex + color] - tabu->neighbor_colors[3 * vertex + old];
+    tabu->colors[vertex] = color;
+
+    uint32_t i;
+    for (i = adjacency->offsets[vertex]; i < adjacency->offsets[vertex + 1]; i++)
+    {
+        int neighbor = adjacency->neighbors[i];
+        tabu->neighbor_colors[3 * neighbor + old]--;
+        tabu->neighbor_colors[3 * neighbor + color]++;
+        update_conflicted(tabu, neighbor);
+    }
+    update_conflicted(tabu, vertex);
+}
+
+int tabu_run(tabu_t *tabu, rng_t *rng, int bound, int moves)
+{
+    int move;
+    for (move = 0; move < moves && tabu->conflicts >= bound; move++)
+    {
+        if (tabu->iteration - tabu->best_iteration > TABU_RESTART_ITERATIONS) restart(tabu, rng);
+        if (tabu->conflicted_count == 0) break;    // only self loops are left
+        tabu->iteration++;
+
+        int vertex = tabu->conflicted[draw(rng, tabu->conflicted_count)];
+        int old = tabu->colors[vertex];
+        const int *counts = &tabu->neighbor_colors[3 * vertex];
+
+        /* best color that is not tabu, or that beats the best coloring (aspiration) */
+        int color, best_color = -1, best_delta = 0;
+        for (color = 0; color < 3; color++)
+        {
+            if (color == old) continue;
+            int delta = counts[color] - counts[old];
+            bool allowed = tabu->tabu_until[3 * vertex + color] <= tabu->iteration || tabu->conflicts + delta < tabu->best;
+            if (allowed && (best_color == -1 || delta < best_delta || (delta == best_delta && (rng_next(rng) & 1))))
+            {
+                best_color = color;
+                best_delta = delta;
+            }
+        }
+        /* like min-conflicts, keep the color if every move would add conflicts, except for some random walk */
+        if (best_color == -1 || (best_delta > 0 && draw(rng, 100) >= TABU_WALK_PERCENT)) continue;
+
+        /* the tenure grows with the count of conflicted vertices, so big conflict sets do not cycle */
+        tabu->tabu_until[3 * vertex + old] = tabu->iteration + 10 + draw(rng, 10) + (uint64_t)tabu->conflicted_count * 6 / 10;
+        recolor(tabu, vertex, best_color);
+
+        if (tabu->conflicts < tabu->best)
+        {
+            tabu->best = tabu->conflicts;
+            tabu->best_iteration = tabu->iteration;
+        }
+    }
+    return tabu->conflicts;
+}
+
+void tabu_colors(const tabu_t *tabu, int *colors)
+{
+    int v;
+    for (v = 0; v < tabu->graph->vertices_count; v++) colors[v] = tabu->colors[v] + 1;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file tabu.h
+ * @author Tobias Scharsching e12123692@student.tuwien.ac.at
+ * @date 11.11.2022
+ *
+ * @brief Local search for the 3color problem: min-conflicts moves with a
+ * tabu list and restarts, as alternative to random colorings.
+ **/
+
+#ifndef TABU_H
+#define TABU_H
+
+#include <stdint.h>
+
+#include "graph.h"
+
+/**
+ * @brief Iterations without a new best after which the search restarts from a random coloring
+ */
+#define TABU_RESTART_ITERATIONS 200000
+
+/**
+ * @brief Percentage of moves that are taken although they add conflicts, to leave local minima
+ */
+#define TABU_WALK_PERCENT 2
+
+/**
+ * @brief Neighbors of all vertices in compressed sparse row form, shared read only by all searches
+ * @details
+ * self loops are left out, they conflict with every coloring
+ */
+typedef struct adjacency {
+    uint32_t *offsets; /** neighbors of vertex v are neighbors[offsets[v]..offsets[v+1]-1] */
+    int32_t *neighbors; /** dense indices of the neighbors */
+    int self_loops; /** count of self loops in the graph */
+} adjacency_t;
+
+/**
+ * @brief State of one local search
+ */
+typedef struct tabu {
+    const graph_t *graph; /** the graph */
+    const adjacency_t *adjacency; /** neighbors of the vertices */
+    int *colors; /** current color of each vertex, 0..2 */
+    int *neighbor_colors; /** count of neighbors with color c of vertex v at [3 * v + c] */
+    uint64_t *tabu_until; /** iteration until which color c is tabu for vertex v, at [3 * v + c] */
+    int *conflicted; /** vertices that have a neighbor of their color */
+    int *position; /** index of each vertex in conflicted, -1 if not contained */
+    int conflicted_count; /** count of conflicted vertices */
+    int conflicts; /** count of conflicting edges of the current coloring, including self loops */
+    int best; /** fewest conflicts since the last restart */
+    uint64_t iteration; /** count of moves */
+    uint64_t best_iteration; /** iteration best was found at */
+} tabu_t;
+
+/**
+ * @brief Builds the adjacency of a graph from its degree table
+ *
+ * @param adjacency the adjacency
+ * @param graph the graph
+ * @return 0 on success, -1 if allocation failed
+ */
+int adjacency_build(adjacency_t *adjacency, const graph_t *graph);
+
+/**
+ * @brief Releases an adjacency
+ *
+ * @param adjacency the adjacency
+ */
+void adjacency_free(adjacency_t *adjacency);
+
+/**
+ * @brief Allocates a local search and starts it from a random coloring
+ *
+ * @param tabu the search
+ * @param graph the graph
+ * @param adjacency the adjacency of the graph
+ * @param rng the random generator of the calling thread
+ * @return 0 on success, -1 if allocation failed
+ */
+int tabu_init(tabu_t *tabu, const graph_t *graph, const adjacency_t *adjacency, rng_t *rng);
+
+/**
+ * @brief Releases a local search
+ *
+ * @param tabu the search
+ */
+void tabu_free(tabu_t *tabu);
+
+/**
+ * @brief Moves until the coloring has fewer conflicts than a bound or a count of moves is done
+ * @details
+ * every move recolors a random conflicting vertex to the color with the fewest conflicts that is
+ * not tabu, unless it beats the best coloring; the old color becomes tabu for the vertex. Moves that
+ * add conflicts are only taken as rare random walk. Moves update the neighbor color counts in O(degree)
+ *
+ * @param tabu the search
+ * @param rng the random generator of the calling thread
+ * @param bound the count of conflicts to get below
+ * @param moves the maximal count of moves
+ * @return the conflicts of the current coloring, which is below bound if it was reached;
+ * returns at once if only self loops conflict, callers stop once self_loops reaches the bound
+ */
+int tabu_run(tabu_t *tabu, rng_t *rng, int bound, int moves);
+
+/**
+ * @brief Converts the current coloring of a search to colors 1..3 for coloring_conflicts
+ *
+ * @param tabu the search
+ * @param colors array of vertices_count colors which will hold the coloring
+ */
+void tabu_colors(const tabu_t *tabu, int *colors);
+
+#endif